@@ -4,152 +4,5013 @@
  */
 
 #include <tesseract/baseapi.h>
+#include <tesseract/ocrclass.h>
 #include <leptonica/allheaders.h>
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <unordered_map>
 #include <string>
+#include <string_view>
+#include <memory_resource>
+#include <array>
+#include <memory>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <numeric>
+#include <chrono>
+#include <functional>
+#include <atomic>
 #include <regex>
 #include <algorithm>
 #include <cctype>
 #include <locale>
+// min и max из windows.h — макросы и ломают std::min со списком инициализации.
+#define NOMINMAX
 #include <windows.h>
+#include <io.h>
 
 using namespace std;
 
+/**
+ * @enum CaptionRole
+ * @brief Роль подписи многостраничной таблицы.
+ */
+enum class CaptionRole {
+    Start,          ///< «Таблица 3.2» — начало таблицы.
+    Continuation,   ///< «Продолжение таблицы 3.2».
+    End,            ///< «Окончание таблицы 3.2».
+};
+
 /**
  * @struct TableInfo
  * @brief Структура для хранения информации о таблице.
  *
+ * Строки размещаются в памяти, выделенной аллокатором страницы, поэтому
+ * результаты разбора освобождаются одним вызовом вместе с ареной.
+ *
+ * @var TableInfo::type
+ * Тип подписи («Таблица», «Рисунок», ...); ссылается на строку сканера подписей.
+ * @var TableInfo::role
+ * Начало таблицы или повторная подпись её продолжения.
  * @var TableInfo::number
  * Номер таблицы в виде строки.
  * @var TableInfo::title
  * Название таблицы.
+ * @var TableInfo::line
+ * Номер строки подписи в распознанном тексте (с нуля).
+ * @var TableInfo::numberEnd
+ * Смещение в байтах от начала строки до конца номера: дальше в строке
+ * может стоять ссылка на другую таблицу.
  */
 struct TableInfo {
-    string number;
-    string title;
+    using allocator_type = pmr::polymorphic_allocator<char>;
+
+    string_view type;
+    CaptionRole role = CaptionRole::Start;
+    pmr::string number;
+    pmr::string title;
+    size_t line = 0;
+    size_t numberEnd = 0;
+
+    explicit TableInfo(const allocator_type& alloc = {})
+        : number(alloc), title(alloc) {}
+    TableInfo(const TableInfo& other, const allocator_type& alloc = {})
+        : type(other.type), role(other.role), number(other.number, alloc), title(other.title, alloc), line(other.line),
+        numberEnd(other.numberEnd) {}
+    TableInfo(TableInfo&& other, const allocator_type& alloc)
+        : type(other.type), role(other.role), number(move(other.number), alloc), title(move(other.title), alloc),
+        line(other.line), numberEnd(other.numberEnd) {}
+    TableInfo(TableInfo&&) = default;
+    TableInfo& operator=(const TableInfo&) = default;
+    TableInfo& operator=(TableInfo&&) = default;
 };
 
 /**
- * @brief Извлекает информацию о таблицах из текста.
- * @param text Текст для анализа.
- * @return Вектор структур TableInfo с информацией о таблицах.
+ * @struct TableReference
+ * @brief Ссылка на таблицу в тексте («см. табл. 3», «в таблице 2.4»).
+ *
+ * @var TableReference::number
+ * Номер таблицы, на которую ссылается текст.
+ * @var TableReference::line
+ * Номер строки ссылки в распознанном тексте (с нуля).
  */
-vector<TableInfo> extractTableInfo(const string& text) {
-    vector<TableInfo> tables;
-    regex tablePattern(R"(Таблица\s+([\d.]+)(?:\s+.*?\s+(.*))?)");
-    stringstream ss(text);
-    string line;
+struct TableReference {
+    using allocator_type = pmr::polymorphic_allocator<char>;
+
+    pmr::string number;
+    size_t line = 0;
+
+    explicit TableReference(const allocator_type& alloc = {})
+        : number(alloc) {}
+    TableReference(const TableReference& other, const allocator_type& alloc = {})
+        : number(other.number, alloc), line(other.line) {}
+    TableReference(TableReference&& other, const allocator_type& alloc)
+        : number(move(other.number), alloc), line(other.line) {}
+    TableReference(TableReference&&) = default;
+    TableReference& operator=(const TableReference&) = default;
+    TableReference& operator=(TableReference&&) = default;
+};
+
+/**
+ * @struct ContentsEntry
+ * @brief Строка перечня таблиц («Таблица 3 – Название ........ 12»).
+ *
+ * @var ContentsEntry::number
+ * Номер таблицы.
+ * @var ContentsEntry::title
+ * Название таблицы без отточия и номера страницы.
+ * @var ContentsEntry::page
+ * Номер страницы, указанный в перечне.
+ */
+struct ContentsEntry {
+    using allocator_type = pmr::polymorphic_allocator<char>;
+
+    pmr::string number;
+    pmr::string title;
+    int page = 0;
+
+    explicit ContentsEntry(const allocator_type& alloc = {})
+        : number(alloc), title(alloc) {}
+    ContentsEntry(const ContentsEntry& other, const allocator_type& alloc = {})
+        : number(other.number, alloc), title(other.title, alloc), page(other.page) {}
+    ContentsEntry(ContentsEntry&& other, const allocator_type& alloc)
+        : number(move(other.number), alloc), title(move(other.title), alloc), page(other.page) {}
+    ContentsEntry(ContentsEntry&&) = default;
+    ContentsEntry& operator=(const ContentsEntry&) = default;
+    ContentsEntry& operator=(ContentsEntry&&) = default;
+};
+
+/**
+ * @struct MisorderedPair
+ * @brief Пара соседних таблиц, нарушающих порядок нумерации.
+ *
+ * Поля ссылаются на номера из вектора TableInfo и копии в арене страницы
+ * и действительны, пока жива арена страницы.
+ */
+struct MisorderedPair {
+    string_view type;
+    string_view number;
+    string_view previous;
+};
+
+/**
+ * @struct NumberingState
+ * @brief Состояние проверки нумерации, переносимое со страницы на страницу.
+ *
+ * Для каждого типа подписей хранится последний начатый номер и признак того,
+ * что таблица уже закрыта подписью «Окончание таблицы».
+ */
+struct NumberingState {
+    struct Entry {
+        string_view type;
+        string number;
+        bool closed = false;
+    };
+    vector<Entry> entries;
+};
+
+/**
+ * @struct ReferenceIndex
+ * @brief Обратный индекс документа: номер таблицы → её подпись и ссылки на неё.
+ *
+ * Заполняется страница за страницей в порядке документа, поэтому каждая
+ * подпись и ссылка обрабатываются один раз, а ссылки, встреченные до
+ * подписи, составляют начало списка ссылок.
+ */
+struct ReferenceIndex {
+    /// Положение в документе: номер страницы в pages и строки на ней.
+    struct Position {
+        size_t page = 0;
+        size_t line = 0;
+    };
+    struct Entry {
+        bool captioned = false;
+        Position caption;
+        vector<Position> references;
+        size_t referencesBeforeCaption = 0;
+    };
+    vector<string> pages;
+    unordered_map<string, Entry> entries;
+    /// Номера в порядке первого упоминания, чтобы отчёт не зависел от хеширования.
+    vector<string> order;
+};
+
+/**
+ * @struct ContentsIndex
+ * @brief Перечень таблиц документа и найденные подписи для сверки с ним.
+ *
+ * @var ContentsIndex::listed
+ * Строки перечня в порядке документа.
+ * @var ContentsIndex::found
+ * Первая подпись каждой таблицы: название, номер страницы по колонтитулу
+ * (0, если не распознан) и путь к изображению.
+ */
+struct ContentsIndex {
+    struct Found {
+        string title;
+        int page = 0;
+        string path;
+    };
+    vector<ContentsEntry> listed;
+    unordered_map<string, Found> found;
+};
+
+struct Journal;
+struct Progress;
+
+/**
+ * @struct DocumentState
+ * @brief Состояние проверок, переносимое со страницы на страницу документа.
+ *
+ * @var DocumentState::journal
+ * Журнал обработанных страниц или nullptr, если он не ведётся.
+ * @var DocumentState::costLog
+ * Журнал признаков и времени распознавания страниц (--cost-log) или nullptr.
+ * @var DocumentState::progress
+ * Прогноз оставшегося времени по модели стоимости или nullptr, если модели нет.
+ * @var DocumentState::enginesReady
+ * Момент, когда исполнители schedulePages загрузили модели (только с --report-time).
+ */
+struct DocumentState {
+    NumberingState numbering;
+    ReferenceIndex references;
+    ContentsIndex contents;
+    Journal* journal = nullptr;
+    FILE* costLog = nullptr;
+    Progress* progress = nullptr;
+    chrono::steady_clock::time_point enginesReady;
+};
+
+/**
+ * @struct OcrLine
+ * @brief Распознанная строка текста и её положение.
+ *
+ * @var OcrLine::text
+ * Текст строки без перевода строки.
+ * @var OcrLine::box
+ * Рамка строки в координатах распознанного фрагмента.
+ * @var OcrLine::block
+ * Номер блока разметки Tesseract, в который входит строка.
+ * @var OcrLine::digitChoices
+ * Символы, распознанные не как цифра, но с цифрой среди альтернатив:
+ * смещение символа в text и цифра, по возрастанию смещений (--glyph-choices).
+ */
+struct OcrLine {
+    string text;
+    cv::Rect box;
+    int block = 0;
+    vector<pair<size_t, char>> digitChoices;
+};
+
+/**
+ * @brief Склеивает строки в текст, по строке на каждую OcrLine.
+ * @param lines Строки.
+ * @return Текст, в котором n-я строка соответствует lines[n].
+ */
+string joinLines(const vector<OcrLine>& lines) {
+    string text;
+    for (const OcrLine& line : lines) {
+        text += line.text;
+        text += '\n';
+    }
+    return text;
+}
+
+/**
+ * @brief Добавляет строки фрагмента к строкам страницы.
+ *
+ * Номера блоков фрагмента сдвигаются за уже занятые, чтобы строки разных
+ * фрагментов не считались одним блоком.
+ *
+ * @param lines Строки страницы.
+ * @param more Строки очередного фрагмента.
+ * @param offset Смещение фрагмента на странице.
+ */
+void appendLines(vector<OcrLine>& lines, vector<OcrLine> more, cv::Point offset = cv::Point()) {
+    int firstBlock = 0;
+    for (const OcrLine& line : lines)
+        firstBlock = max(firstBlock, line.block + 1);
+    for (OcrLine& line : more) {
+        line.box.x += offset.x;
+        line.box.y += offset.y;
+        line.block += firstBlock;
+        lines.push_back(move(line));
+    }
+}
 
-    while (getline(ss, line)) {
-        smatch match;
-        if (regex_search(line, match, tablePattern)) {
-            TableInfo table;
-            table.number = match.str(1);
-            table.title = match.str(2);
-            tables.push_back(table);
+/**
+ * @brief Декодирует один символ UTF-8.
+ * @param p Текущая позиция; сдвигается за прочитанный символ.
+ * @param end Конец текста.
+ * @return Код символа или U+FFFD для некорректной последовательности.
+ */
+char32_t decodeUtf8(const char*& p, const char* end) {
+    unsigned char lead = static_cast<unsigned char>(*p++);
+    if (lead < 0x80)
+        return lead;
+    int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+    if (extra < 0 || end - p < extra)
+        return U'\uFFFD';
+    char32_t code = lead & (0x3F >> extra);
+    for (int i = 0; i < extra; ++i) {
+        unsigned char next = static_cast<unsigned char>(*p);
+        if ((next & 0xC0) != 0x80)
+            return U'\uFFFD';
+        code = (code << 6) | (next & 0x3F);
+        ++p;
+    }
+    return code;
+}
+
+/**
+ * @brief Приводит символ к алфавиту сравнения ключевых слов.
+ *
+ * Латинские буквы, которые Tesseract путает с похожими кириллическими
+ * (T/Т, a/а, o/о, n/п, u/и и т. п.), заменяются кириллическими, ё — на е.
+ * Регистр сохраняется: подпись начинается с заглавной буквы, а ссылки
+ * в тексте («в таблице 3») — со строчной. Таблица строится один раз.
+ *
+ * @param ch Символ.
+ * @return Приведённый символ.
+ */
+char32_t foldKeywordChar(char32_t ch) {
+    static const array<char32_t, 0x500> folded = [] {
+        array<char32_t, 0x500> table{};
+        for (char32_t c = 0; c < table.size(); ++c)
+            table[c] = c;
+        const pair<char32_t, char32_t> lookalikes[] = {
+            { U'A', U'А' }, { U'B', U'В' }, { U'C', U'С' }, { U'E', U'Е' }, { U'H', U'Н' },
+            { U'K', U'К' }, { U'M', U'М' }, { U'O', U'О' }, { U'P', U'Р' }, { U'T', U'Т' },
+            { U'X', U'Х' }, { U'Y', U'У' }, { U'a', U'а' }, { U'c', U'с' }, { U'e', U'е' },
+            { U'k', U'к' }, { U'n', U'п' }, { U'o', U'о' }, { U'p', U'р' }, { U'u', U'и' },
+            { U'x', U'х' }, { U'y', U'у' }, { U'ё', U'е' }, { U'Ё', U'Е' },
+        };
+        for (auto [from, to] : lookalikes)
+            table[from] = to;
+        return table;
+    }();
+    return ch < folded.size() ? folded[ch] : ch;
+}
+
+/**
+ * @struct FuzzyKeyword
+ * @brief Сравнение начала строки с ключевым словом с ограниченным числом ошибок.
+ *
+ * Реализует бит-параллельный алгоритм Майерса: расстояние редактирования
+ * до всех префиксов слова обновляется за несколько машинных операций на
+ * символ текста. Вхождение привязано к заданной позиции, а первая буква
+ * слова должна совпасть точно: ссылка в тексте («см. рисунок 2») начинается
+ * со строчной буквы и не считается подписью с одной ошибкой.
+ * Длина слова не больше 64 символов.
+ */
+struct FuzzyKeyword {
+    /** Маски позиций каждого различного символа слова. */
+    vector<pair<char32_t, uint64_t>> peq;
+    uint64_t lastBit = 0;
+    char32_t firstChar = 0;
+    int length = 0;
+
+    /**
+     * @brief Готовит таблицу масок для слова.
+     * @param keyword Непустое ключевое слово в UTF-8.
+     */
+    explicit FuzzyKeyword(string_view keyword) {
+        const char* p = keyword.data();
+        const char* end = p + keyword.size();
+        while (p < end && length < 64) {
+            char32_t ch = foldKeywordChar(decodeUtf8(p, end));
+            if (length == 0)
+                firstChar = ch;
+            auto it = find_if(peq.begin(), peq.end(), [ch](const auto& entry) { return entry.first == ch; });
+            if (it == peq.end())
+                it = peq.insert(peq.end(), { ch, 0 });
+            it->second |= uint64_t(1) << length++;
         }
+        lastBit = uint64_t(1) << (length - 1);
     }
 
-    return tables;
+    /**
+     * @brief Находит лучшее вхождение слова, начинающееся в позиции from.
+     * @param text Приведённые символы строки.
+     * @param from Позиция, с которой должно начинаться слово.
+     * @param maxErrors Допустимое число ошибок.
+     * @param[out] first Первая позиция за вхождением, где ошибок не больше maxErrors.
+     * @param[out] last Последняя такая позиция подряд: лишние буквы в конце слова
+     *                  («Таблицаа») дают конец вхождения дальше лучшего.
+     * @return Позиция сразу за вхождением или npos, если вхождения нет.
+     */
+    size_t find(const pmr::u32string& text, size_t from, int maxErrors, size_t& first, size_t& last) const {
+        first = last = u32string::npos;
+        if (from >= text.size() || text[from] != firstChar)
+            return u32string::npos;
+        uint64_t pv = ~uint64_t(0);
+        uint64_t mv = 0;
+        int score = length;
+        int bestScore = maxErrors + 1;
+        size_t bestEnd = u32string::npos;
+        const size_t to = min(text.size(), from + length + maxErrors);
+        for (size_t j = from; j < to; ++j) {
+            uint64_t eq = 0;
+            for (const auto& [ch, mask] : peq) {
+                if (ch == text[j]) {
+                    eq = mask;
+                    break;
+                }
+            }
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & lastBit)
+                ++score;
+            else if (mh & lastBit)
+                --score;
+            // Единица в нулевой строке: пропуск символов перед словом стоит ошибку,
+            // поэтому слово начинается ровно в from.
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+
+            // Среди подряд идущих совпадений берётся позиция с наименьшим числом ошибок.
+            if (score <= maxErrors) {
+                if (first == u32string::npos)
+                    first = j + 1;
+                last = j + 1;
+                if (score < bestScore) {
+                    bestScore = score;
+                    bestEnd = j + 1;
+                }
+            }
+            else if (bestEnd != u32string::npos) {
+                break;
+            }
+        }
+        return bestEnd;
+    }
+};
+
+/** Допустимое по умолчанию число ошибок распознавания в ключевом слове. */
+const int defaultKeywordErrors = 1;
+
+/** Тип подписей таблиц. */
+const string_view tableCaptionType = "Таблица";
+
+/**
+ * @struct CaptionScanner
+ * @brief Однопроходный поиск подписей нескольких типов.
+ *
+ * Ключевые слова в приведённом алфавите (см. foldKeywordChar) собираются в
+ * автомат Ахо — Корасик, который за один проход по строке находит все
+ * точные вхождения всех слов. Строки без точного вхождения проверяются
+ * нечётко (см. FuzzyKeyword), но только в начале строки, где стоит подпись,
+ * поэтому стоимость нечёткой проверки не зависит от длины строки.
+ *
+ * Ключевое слово задаётся как «слово» или «слово=тип», например
+ * «Table=Таблица»: тогда английские подписи нумеруются вместе с русскими.
+ * Суффикс «:cont» или «:end» у типа помечает повторные подписи
+ * многостраничных таблиц: «Продолжение таблицы=Таблица:cont».
+ */
+struct CaptionScanner {
+    /** Узел автомата: переходы, суффиксная ссылка и найденное слово. */
+    struct Node {
+        vector<pair<char32_t, int>> next;
+        int fail = 0;
+        int keyword = -1;
+        int outputLink = -1;
+    };
+
+    vector<string> types;
+    vector<CaptionRole> roles;
+    vector<FuzzyKeyword> fuzzy;
+    /** Порядок нечёткой проверки: сначала длинные слова, чтобы «Продолжение
+     *  Таблицы» не было принято за «Таблица» с ошибкой. */
+    vector<int> fuzzyOrder;
+    vector<Node> nodes;
+    int maxErrors;
+
+    /**
+     * @brief Строит автомат по набору ключевых слов.
+     * @param keywords Ключевые слова в виде «слово», «слово=тип» или «слово=тип:роль».
+     * @param maxErrors Допустимое число ошибок при нечёткой проверке.
+     */
+    CaptionScanner(const vector<string>& keywords, int maxErrors)
+        : nodes(1), maxErrors(maxErrors) {
+        for (const string& spec : keywords) {
+            const size_t eq = spec.find('=');
+            const string word = spec.substr(0, eq);
+            string type = eq == string::npos ? word : spec.substr(eq + 1);
+            CaptionRole role = CaptionRole::Start;
+            const size_t colon = type.rfind(':');
+            if (colon != string::npos) {
+                const string suffix = type.substr(colon + 1);
+                role = suffix == "end" ? CaptionRole::End : suffix == "cont" ? CaptionRole::Continuation : CaptionRole::Start;
+                type.erase(colon);
+            }
+            types.push_back(type);
+            roles.push_back(role);
+            fuzzy.emplace_back(word);
+
+            int state = 0;
+            const char* p = word.data();
+            const char* end = p + word.size();
+            while (p < end) {
+                char32_t ch = foldKeywordChar(decodeUtf8(p, end));
+                int next = child(state, ch);
+                if (next < 0) {
+                    next = int(nodes.size());
+                    nodes[state].next.emplace_back(ch, next);
+                    nodes.emplace_back();
+                }
+                state = next;
+            }
+            if (nodes[state].keyword < 0)
+                nodes[state].keyword = int(types.size() - 1);
+        }
+
+        for (size_t k = 0; k < fuzzy.size(); ++k)
+            fuzzyOrder.push_back(int(k));
+        stable_sort(fuzzyOrder.begin(), fuzzyOrder.end(), [this](int a, int b) {
+            return fuzzy[a].length > fuzzy[b].length;
+            });
+
+        // Суффиксные ссылки строятся обходом в ширину.
+        vector<int> queue;
+        for (auto [ch, next] : nodes[0].next)
+            queue.push_back(next);
+        for (size_t i = 0; i < queue.size(); ++i) {
+            const int state = queue[i];
+            for (auto [ch, next] : nodes[state].next) {
+                int fail = nodes[state].fail;
+                while (fail > 0 && child(fail, ch) < 0)
+                    fail = nodes[fail].fail;
+                int target = child(fail, ch);
+                nodes[next].fail = target >= 0 && target != next ? target : 0;
+                const Node& suffix = nodes[nodes[next].fail];
+                nodes[next].outputLink = suffix.keyword >= 0 ? nodes[next].fail : suffix.outputLink;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    /**
+     * @brief Возвращает переход из узла по символу.
+     * @return Номер узла или -1, если перехода нет.
+     */
+    int child(int state, char32_t ch) const {
+        for (auto [c, next] : nodes[state].next)
+            if (c == ch)
+                return next;
+        return -1;
+    }
+
+    /**
+     * @brief Выполняет шаг автомата с учётом суффиксных ссылок.
+     */
+    int step(int state, char32_t ch) const {
+        for (;;) {
+            int next = child(state, ch);
+            if (next >= 0)
+                return next;
+            if (state == 0)
+                return 0;
+            state = nodes[state].fail;
+        }
+    }
+};
+
+/**
+ * @brief Возвращает цифру, с которой распознавание обычно путает символ.
+ *
+ * Таблица строится один раз: | ! l I → 1, О o → 0, З з → 3, б → 6.
+ * Заглавные О и З не бывают буквами приложений по ГОСТ 2.105, поэтому
+ * их замена не портит обозначения вида «Б.1».
+ *
+ * @param ch Символ.
+ * @return Цифра или 0, если символ не путается с цифрой.
+ */
+char digitConfusion(char32_t ch) {
+    static const array<char, 0x500> digits = [] {
+        array<char, 0x500> table{};
+        const pair<char32_t, char> confusions[] = {
+            { U'|', '1' }, { U'!', '1' }, { U'l', '1' }, { U'I', '1' },
+            { U'O', '0' }, { U'o', '0' }, { U'О', '0' }, { U'о', '0' },
+            { U'З', '3' }, { U'з', '3' }, { U'б', '6' },
+        };
+        for (auto [from, to] : confusions)
+            table[from] = to;
+        return table;
+    }();
+    return ch < digits.size() ? digits[ch] : 0;
 }
 
 /**
- * @brief Находит таблицы, расположенные не по порядку.
- * @param tables Вектор структур TableInfo для анализа.
- * @return Вектор строк с номерами таблиц, расположенных не по порядку.
+ * @brief Читает номер подписи сразу после ключевого слова.
+ *
+ * Номер — цифры с точками («3.2»), буква приложения с номером («А.1») или
+ * одна буква приложения («Приложение Б»). Перед номером обязателен пробел.
+ * Символы, которые распознавание путает с цифрами, исправляются только
+ * здесь, в номере: по цифре из альтернатив распознавания символа
+ * (OcrLine::digitChoices), а без неё — по digitConfusion. Запятая между
+ * цифрами считается точкой.
+ *
+ * @param p Позиция сразу за ключевым словом; сдвигается за номер.
+ * @param end Конец строки.
+ * @param number Исправленный номер.
+ * @param digitChoices Цифры из альтернатив символов строки или nullptr.
+ * @param lineBegin Начало строки, от которого отсчитаны смещения digitChoices.
+ * @return false, если номера нет.
  */
-vector<string> findMisorderedTables(const vector<TableInfo>& tables) {
-    vector<string> misordered;
-    string prevNumber = "0";  // Инициализация с нулевым номером для сравнения с первой таблицей
+bool readCaptionNumber(const char*& p, const char* end, pmr::string& number,
+    const vector<pair<size_t, char>>* digitChoices = nullptr, const char* lineBegin = nullptr) {
+    const char* start = p;
+    while (p < end && isspace(static_cast<unsigned char>(*p)))
+        ++p;
+    if (p == start)
+        return false;
 
-    for (const auto& table : tables) {
-        if (table.number <= prevNumber) {
-            misordered.push_back(table.number);
-            misordered.push_back(prevNumber);
+    number.clear();
+    bool hasLetter = false, hasDigit = false;
+    const char* next = p;
+    char32_t ch = p < end ? decodeUtf8(next, end) : 0;
+    const bool latinCapital = ch >= U'A' && ch <= U'Z';
+    const bool cyrillicCapital = ch >= U'А' && ch <= U'Я';
+    if ((latinCapital || cyrillicCapital) && !digitConfusion(ch)) {
+        number.assign(p, next);
+        p = next;
+        hasLetter = true;
+    }
+
+    auto isDigit = [](char32_t c) { return c < 0x80 && isdigit(int(c)); };
+    auto confusion = [&](const char* at, char32_t c) {
+        if (digitChoices) {
+            const size_t offset = size_t(at - lineBegin);
+            auto choice = lower_bound(digitChoices->begin(), digitChoices->end(), make_pair(offset, '\0'));
+            if (choice != digitChoices->end() && choice->first == offset)
+                return choice->second;
+        }
+        return digitConfusion(c);
+    };
+    auto isLetter = [](char32_t c) {
+        return (c < 0x80 && isalpha(int(c))) || (c >= U'А' && c <= U'я') || c == U'Ё' || c == U'ё';
+    };
+
+    const char* afterLetter = p;
+    bool afterDigit = false;
+    while (p < end) {
+        next = p;
+        ch = decodeUtf8(next, end);
+        char digit = isDigit(ch) ? char(ch) : 0;
+        if (!digit && confusion(p, ch)) {
+            // Путаемый символ считается цифрой, только если он в ряду цифр и за рядом нет букв:
+            // в «3.Общие» «О» — начало слова, а не ноль.
+            bool besideDigit = afterDigit;
+            char32_t following = 0;
+            for (const char* q = next; q < end; following = 0) {
+                const char* r = q;
+                following = decodeUtf8(r, end);
+                if (isDigit(following))
+                    besideDigit = true;
+                else if (!confusion(q, following))
+                    break;
+                q = r;
+            }
+            if (besideDigit && !isLetter(following))
+                digit = confusion(p, ch);
         }
-        prevNumber = table.number;
+        if (digit) {
+            number += digit;
+            hasDigit = true;
+            afterDigit = true;
+        }
+        else if (ch == U'.' || (ch == U',' && hasDigit && next < end && isdigit(static_cast<unsigned char>(*next)))) {
+            number += '.';
+            afterDigit = false;
+        }
+        else {
+            break;
+        }
+        p = next;
     }
 
-    return misordered;
+    if (hasDigit || (hasLetter && p == afterLetter && (p == end || isspace(static_cast<unsigned char>(*p)))))
+        return true;
+    p = start;
+    return false;
 }
 
 /**
  * @brief Удаляет пробелы с начала и конца строки.
  * @param str Строка для обработки.
- * @return Обработанная строка.
+ * @return Подстрока без пробелов по краям (без копирования).
  */
-string trim(const string& str) {
-    string s = str;
-    s.erase(s.begin(), find_if(s.begin(), s.end(), [](unsigned char ch) {
+string_view trim(string_view str) {
+    auto first = find_if(str.begin(), str.end(), [](unsigned char ch) {
         return !isspace(ch);
-        }));
-    s.erase(find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
+        });
+    auto last = find_if(str.rbegin(), str.rend(), [](unsigned char ch) {
         return !isspace(ch);
-        }).base(), s.end());
-    return s;
+        }).base();
+    if (first >= last)
+        return {};
+    return str.substr(first - str.begin(), last - first);
 }
 
 /**
- * @brief Точка входа в программу.
- * Использует Tesseract и OpenCV для распознавания и анализа таблиц в изображении.
- * @return Код завершения программы.
+ * @brief Дописывает к названию подписи строки, на которые оно перенесено.
+ *
+ * Строка считается продолжением названия, если она в том же блоке разметки,
+ * отстоит от предыдущей не больше чем на 0.8 высоты строки, набрана тем же
+ * кеглем (высота в пределах 0.6–1.5) и не сдвинута вправо больше чем на две
+ * высоты строки, если только не центрирована под подписью. Перенос со знаком
+ * «-» в конце строки склеивается без пробела.
+ *
+ * @param table Подпись, название которой дополняется.
+ * @param layout Разметка строк.
+ * @param captionLine Строка подписи.
+ * @param stop Строка, на которой продолжение заканчивается в любом случае (следующая подпись).
  */
-int main() {
-    SetConsoleOutputCP(CP_UTF8);
+void appendWrappedTitle(TableInfo& table, const vector<OcrLine>& layout, size_t captionLine, size_t stop) {
+    if (captionLine >= layout.size())
+        return;
+    const OcrLine& head = layout[captionLine];
+    const int lineHeight = max(1, head.box.height);
+    const int headCenter = head.box.x + head.box.width / 2;
+    int prevBottom = head.box.br().y;
 
-    cv::Mat img = cv::imread("4_1.png");
+    for (size_t j = captionLine + 1; j < min(stop, layout.size()); ++j) {
+        const OcrLine& next = layout[j];
+        string_view text = trim(next.text);
+        if (next.block != head.block || text.empty())
+            break;
+        const int gap = next.box.y - prevBottom;
+        if (gap < -lineHeight / 2 || gap > lineHeight * 8 / 10)
+            break;
+        if (next.box.height * 10 < lineHeight * 6 || next.box.height * 10 > lineHeight * 15)
+            break;
+        const bool centered = abs(next.box.x + next.box.width / 2 - headCenter) < 2 * lineHeight;
+        if (next.box.x > head.box.x + 2 * lineHeight && !centered)
+            break;
 
-    if (img.empty()) {
-        cerr << "Ошибка: изображение не загружено." << endl;
-        return -1;
+        while (!table.title.empty() && isspace(static_cast<unsigned char>(table.title.back())))
+            table.title.pop_back();
+        const size_t n = table.title.size();
+        if (n >= 2 && table.title[n - 1] == '-' && !isspace(static_cast<unsigned char>(table.title[n - 2])))
+            table.title.pop_back();
+        else if (n > 0)
+            table.title += ' ';
+        table.title.append(text);
+        prevBottom = next.box.br().y;
     }
+}
+
+/**
+ * @brief Извлекает информацию о таблицах из текста.
+ *
+ * Находит подписи всех типов сканера за один проход по тексту. Подпись
+ * начинается с ключевого слова в начале строки; слово может быть искажено
+ * распознаванием (см. CaptionScanner), за ним должен следовать номер.
+ *
+ * Если известна разметка строк, название, перенесённое на следующие строки,
+ * дописывается из них (см. appendWrappedTitle).
+ *
+ * @param text Текст для анализа.
+ * @param arena Арена страницы, в которой размещаются результаты.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param layout Разметка строк текста (n-я строка текста — layout[n]) или nullptr.
+ * @return Вектор структур TableInfo с информацией о подписях.
+ */
+pmr::vector<TableInfo> extractTableInfo(string_view text, pmr::memory_resource* arena,
+    const CaptionScanner& scanner, const vector<OcrLine>* layout = nullptr) {
+    pmr::vector<TableInfo> tables(arena);
+    // Название — остаток строки после необязательного разделителя: «Таблица 1 – Состав», «Table 3: Results».
+    static const regex titlePattern(R"(\s*(?:–|—|-|:|\.)?\s*(.*))");
+    pmr::cmatch match(arena);
+    pmr::string number(arena);
+    // Приведённые символы строки и их смещения в байтах; память переиспользуется между строками.
+    pmr::u32string folded(arena);
+    pmr::vector<const char*> offsets(arena);
+    // Цифры из альтернатив символов текущей строки (OcrLine::digitChoices).
+    const vector<pair<size_t, char>>* choices = nullptr;
 
-    tesseract::TessBaseAPI* ocr = new tesseract::TessBaseAPI();
+    // Пробует прочитать подпись типа keyword, слово которого заканчивается в позиции end.
+    auto tryCaption = [&](int keyword, size_t end, const char* lineEnd) {
+        const char* p = offsets[end];
+        if (!readCaptionNumber(p, lineEnd, number, choices, offsets.front()))
+            return false;
+        TableInfo& table = tables.emplace_back();
+        table.type = scanner.types[keyword];
+        table.role = scanner.roles[keyword];
+        table.number.assign(number);
+        table.numberEnd = size_t(p - offsets.front());
+        if (regex_search(p, lineEnd, match, titlePattern, regex_constants::match_continuous))
+            table.title.assign(trim(string_view(match[1].first, match[1].second - match[1].first)));
+        return true;
+    };
 
-    const char* tessdata_path = "E:/vcpkg/installed/x64-windows/share/tessdata/";
-    _putenv_s("TESSDATA_PREFIX", tessdata_path);
+    const char* lineBegin = text.data();
+    const char* textEnd = text.data() + text.size();
+    for (size_t lineIndex = 0; lineBegin < textEnd; ++lineIndex) {
+        const char* lineEnd = find(lineBegin, textEnd, '\n');
+        choices = layout && lineIndex < layout->size() ? &(*layout)[lineIndex].digitChoices : nullptr;
 
-    if (ocr->Init(tessdata_path, "eng+rus", tesseract::OEM_LSTM_ONLY)) {
-        cerr << "Не удалось инициализировать tesseract." << endl;
-        return 1;
+        folded.clear();
+        offsets.clear();
+        for (const char* p = lineBegin; p < lineEnd;) {
+            offsets.push_back(p);
+            folded.push_back(foldKeywordChar(decodeUtf8(p, lineEnd)));
+        }
+        offsets.push_back(lineEnd);
+
+        // Подпись начинается с ключевого слова; слово в середине строки — ссылка в тексте («а также Table 7»).
+        const size_t lineStart = find_if(folded.begin(), folded.end(), [](char32_t c) { return c != U' ' && c != U'\t'; })
+            - folded.begin();
+        bool found = false;
+        int state = 0;
+        for (size_t j = 0; j < folded.size() && !found; ++j) {
+            state = scanner.step(state, folded[j]);
+            for (int out = scanner.nodes[state].keyword >= 0 ? state : scanner.nodes[state].outputLink;
+                out >= 0 && !found; out = scanner.nodes[out].outputLink) {
+                const int keyword = scanner.nodes[out].keyword;
+                if (j + 1 == lineStart + scanner.fuzzy[keyword].length)
+                    found = tryCaption(keyword, j + 1, lineEnd);
+            }
+        }
+
+        for (size_t i = 0; i < scanner.fuzzyOrder.size() && !found && scanner.maxErrors > 0; ++i) {
+            const int k = scanner.fuzzyOrder[i];
+            size_t first = 0;
+            size_t last = 0;
+            const size_t end = scanner.fuzzy[k].find(folded, lineStart, scanner.maxErrors, first, last);
+            if (end == u32string::npos)
+                continue;
+            // Сначала лучший конец вхождения, затем остальные в пределах maxErrors.
+            found = tryCaption(k, end, lineEnd);
+            for (size_t other = first; other <= last && !found; ++other) {
+                if (other != end)
+                    found = tryCaption(k, other, lineEnd);
+            }
+        }
+        if (found)
+            tables.back().line = lineIndex;
+        lineBegin = lineEnd + (lineEnd < textEnd ? 1 : 0);
     }
 
-    ocr->SetImage(img.data, img.cols, img.rows, img.channels(), img.step);
+    if (layout) {
+        for (size_t i = 0; i < tables.size(); ++i) {
+            const size_t stop = i + 1 < tables.size() ? tables[i + 1].line : layout->size();
+            appendWrappedTitle(tables[i], *layout, tables[i].line, stop);
+        }
+    }
 
-    char* outText = ocr->GetUTF8Text();
-    string text(outText);
+    return tables;
+}
 
-    replace(text.begin(), text.end(), '|', '1');
+/**
+ * @brief Находит в тексте ссылки на таблицы.
+ *
+ * Ищет слова «таблица» в любом падеже, сокращение «табл.» и английское
+ * «table» с номером после них. Сами подписи таблиц пропускаются, чтобы
+ * «Продолжение таблицы 3» не считалось ссылкой. Текст просматривается один
+ * раз, подписи — вместе с ним по порядку строк.
+ *
+ * @param text Распознанный текст страницы.
+ * @param arena Арена страницы, в которой размещаются результаты.
+ * @param captions Подписи, найденные в том же тексте extractTableInfo.
+ * @return Ссылки в порядке следования в тексте.
+ */
+pmr::vector<TableReference> extractTableReferences(string_view text, pmr::memory_resource* arena,
+    const pmr::vector<TableInfo>& captions) {
+    static const string_view stems[] = { "таблиц", "Таблиц", "табл.", "Табл.", "table", "Table" };
+    auto isLetterByte = [](unsigned char c) { return isalpha(c) || c >= 0x80; };
 
-    //cout << text << endl;
+    pmr::vector<TableReference> references(arena);
+    pmr::string number(arena);
+    size_t nextCaption = 0;
 
-    vector<TableInfo> tables = extractTableInfo(text);
-    vector<string> misorderedTables = findMisorderedTables(tables);
+    const char* lineBegin = text.data();
+    const char* textEnd = text.data() + text.size();
+    for (size_t lineIndex = 0; lineBegin < textEnd; ++lineIndex) {
+        const char* lineEnd = find(lineBegin, textEnd, '\n');
+        const string_view line(lineBegin, lineEnd - lineBegin);
+        lineBegin = lineEnd + (lineEnd < textEnd ? 1 : 0);
 
-    for (const auto& table : tables) {
-        cout << "Номер таблицы: " << table.number << endl;
-        string trimmedTitle = trim(table.title);
-        if (trimmedTitle.empty())
-            cout << "Название таблицы отсутствует" << endl;
-        else
-            cout << "Название таблицы: " << trimmedTitle << endl;
-        cout << "----" << endl;
+        // В строке подписи пропускается сама подпись; ссылки после её номера учитываются.
+        size_t from = 0;
+        while (nextCaption < captions.size() && captions[nextCaption].line <= lineIndex) {
+            const TableInfo& caption = captions[nextCaption++];
+            if (caption.line == lineIndex && caption.type == tableCaptionType)
+                from = max(from, min(caption.numberEnd, line.size()));
+        }
+
+        // Ссылки в строке по порядку: на каждом шаге берётся ближайшая из основ.
+        while (from < line.size()) {
+            size_t at = string_view::npos, stemLength = 0;
+            for (string_view stem : stems) {
+                size_t pos = line.find(stem, from);
+                if (pos < at) {
+                    at = pos;
+                    stemLength = stem.size();
+                }
+            }
+            if (at == string_view::npos)
+                break;
+            from = at + stemLength;
+            if (at > 0 && isLetterByte(static_cast<unsigned char>(line[at - 1])))
+                continue;
+
+            const char* p = line.data() + from;
+            if (line[from - 1] != '.') {
+                while (p < lineEnd && isLetterByte(static_cast<unsigned char>(*p)))
+                    ++p;
+                if (p < lineEnd && *p == '.')
+                    ++p;
+            }
+            if (!readCaptionNumber(p, lineEnd, number) || number.find_first_of("0123456789") == pmr::string::npos)
+                continue;
+
+            TableReference& reference = references.emplace_back();
+            reference.number.assign(number);
+            reference.line = lineIndex;
+            from = p - line.data();
+        }
     }
 
-    if (!misorderedTables.empty()) {
-        cout << "\nНеправильно пронумерованы таблицы: ";
-        for (const string& number : misorderedTables) {
-            cout << number << " ";
+    return references;
+}
+
+/**
+ * @brief Отделяет строки перечня таблиц от подписей страницы.
+ *
+ * Строка перечня распознаётся extractTableInfo как обычная подпись, название
+ * которой заканчивается номером страницы. Подпись считается строкой перечня,
+ * если перед номером стоит отточие или если на странице есть заголовок
+ * «Перечень таблиц» («Список таблиц», «List of tables»). Такие подписи
+ * переносятся из tables в возвращаемый вектор.
+ *
+ * @param text Распознанный текст страницы.
+ * @param tables Подписи страницы; строки перечня из них удаляются.
+ * @param arena Арена страницы, в которой размещаются результаты.
+ * @return Строки перечня в порядке на странице.
+ */
+pmr::vector<ContentsEntry> extractContentsEntries(string_view text, pmr::vector<TableInfo>& tables,
+    pmr::memory_resource* arena) {
+    static const string_view headings[] = { "Перечень таблиц", "ПЕРЕЧЕНЬ ТАБЛИЦ", "Список таблиц",
+        "СПИСОК ТАБЛИЦ", "List of tables", "List of Tables", "LIST OF TABLES" };
+    bool heading = false;
+    for (string_view h : headings)
+        heading |= text.find(h) != string_view::npos;
+
+    pmr::vector<ContentsEntry> entries(arena);
+    auto kept = tables.begin();
+    for (auto it = tables.begin(); it != tables.end(); ++it) {
+        string_view title = trim(it->title);
+        size_t digits = title.size();
+        while (digits > 0 && isdigit(static_cast<unsigned char>(title[digits - 1])))
+            --digits;
+        const size_t pageLength = title.size() - digits;
+
+        // Отточие: точки, подчёркивания и многоточия «…» вперемешку с пробелами.
+        size_t leader = digits;
+        int dots = 0;
+        while (leader > 0) {
+            const char c = title[leader - 1];
+            if (c == '.' || c == '_') {
+                ++dots;
+                --leader;
+            }
+            else if (isspace(static_cast<unsigned char>(c))) {
+                --leader;
+            }
+            else if (leader >= 3 && title.substr(leader - 3, 3) == "…") {
+                dots += 3;
+                leader -= 3;
+            }
+            else {
+                break;
+            }
         }
-        cout << endl;
+
+        const bool entry = it->type == tableCaptionType && pageLength > 0 && pageLength <= 4
+            && leader < digits && (dots >= 3 || heading);
+        if (!entry) {
+            if (kept != it)
+                *kept = move(*it);
+            ++kept;
+            continue;
+        }
+        ContentsEntry& listed = entries.emplace_back();
+        listed.number.assign(it->number);
+        listed.title.assign(trim(title.substr(0, leader)));
+        listed.page = stoi(string(title.substr(digits)));
     }
-    
-    ocr->End();
+    tables.erase(kept, tables.end());
+    return entries;
+}
 
-    cout << "Нажмите Enter, чтобы выйти...";
-    cin.get();  // Добавлено ожидание ввода
+/**
+ * @brief Сравнивает названия таблиц с учётом ошибок распознавания.
+ *
+ * Названия приводятся к нижнему регистру, латинские буквы-двойники
+ * заменяются кириллическими (см. foldKeywordChar), пробелы схлопываются,
+ * конечная точка отбрасывается. Сходство — единица минус расстояние
+ * Левенштейна, делённое на длину более длинного названия.
+ *
+ * @return Сходство от 0 до 1.
+ */
+double titleSimilarity(string_view a, string_view b) {
+    auto normalize = [](string_view text) {
+        u32string result;
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            char32_t ch = foldKeywordChar(decodeUtf8(p, end));
+            if (ch >= U'А' && ch <= U'Я')
+                ch += U'а' - U'А';
+            else if (ch < 0x80)
+                ch = char32_t(tolower(int(ch)));
+            if (ch < 0x80 && isspace(int(ch))) {
+                if (!result.empty() && result.back() != U' ')
+                    result += U' ';
+                continue;
+            }
+            result += ch;
+        }
+        while (!result.empty() && (result.back() == U' ' || result.back() == U'.'))
+            result.pop_back();
+        return result;
+    };
+
+    const u32string x = normalize(a), y = normalize(b);
+    if (x.empty() && y.empty())
+        return 1.0;
+    vector<size_t> row(y.size() + 1), next(y.size() + 1);
+    for (size_t j = 0; j <= y.size(); ++j)
+        row[j] = j;
+    for (size_t i = 1; i <= x.size(); ++i) {
+        next[0] = i;
+        for (size_t j = 1; j <= y.size(); ++j)
+            next[j] = min({ row[j] + 1, next[j - 1] + 1, row[j - 1] + (x[i - 1] == y[j - 1] ? 0 : 1) });
+        swap(row, next);
+    }
+    return 1.0 - double(row[y.size()]) / max(x.size(), y.size());
+}
+
+/**
+ * @brief Сравнивает номера подписей по частям, разделённым точками.
+ *
+ * Числовые части сравниваются как числа («10» после «9»), буквенные —
+ * побайтно (порядок А–Я в UTF-8 совпадает с алфавитным) и идут после
+ * числовых, как приложения после основной части.
+ *
+ * @return Отрицательное, ноль или положительное число, как у strcmp.
+ */
+int compareCaptionNumbers(string_view a, string_view b) {
+    auto isNumber = [](string_view part) {
+        return !part.empty() && all_of(part.begin(), part.end(), [](char ch) {
+            return isdigit(static_cast<unsigned char>(ch));
+            });
+    };
+    while (!a.empty() || !b.empty()) {
+        string_view partA = a.substr(0, a.find('.'));
+        string_view partB = b.substr(0, b.find('.'));
+        a.remove_prefix(min(a.size(), partA.size() + 1));
+        b.remove_prefix(min(b.size(), partB.size() + 1));
 
+        if (partA.empty() != partB.empty())
+            return partA.empty() ? -1 : 1;
+        const bool numberA = isNumber(partA), numberB = isNumber(partB);
+        if (numberA != numberB)
+            return numberA ? -1 : 1;
+        if (numberA) {
+            partA.remove_prefix(min(partA.find_first_not_of('0'), partA.size()));
+            partB.remove_prefix(min(partB.find_first_not_of('0'), partB.size()));
+            if (partA.size() != partB.size())
+                return partA.size() < partB.size() ? -1 : 1;
+        }
+        if (int order = partA.compare(partB))
+            return order;
+    }
     return 0;
+}
+
+/**
+ * @brief Находит таблицы, расположенные не по порядку.
+ *
+ * Нумерация проверяется отдельно для каждого типа подписей. Подписи
+ * «Продолжение/Окончание таблицы N» не начинают новую таблицу: они верны,
+ * если N совпадает с последней начатой и ещё не оконченной таблицей, в том
+ * числе начатой на предыдущих страницах.
+ *
+ * @param tables Вектор структур TableInfo для анализа.
+ * @param arena Арена страницы, в которой размещается отчёт.
+ * @param state Состояние нумерации после предыдущих страниц; обновляется.
+ * @return Пары номеров подписей, расположенных не по порядку.
+ */
+pmr::vector<MisorderedPair> findMisorderedTables(const pmr::vector<TableInfo>& tables, pmr::memory_resource* arena,
+    NumberingState& state) {
+    pmr::vector<MisorderedPair> misordered(arena);
+
+    // Предыдущий номер копируется в арену: запись состояния изменится дальше.
+    auto report = [&](const TableInfo& table, const string& previous) {
+        char* copy = static_cast<char*>(arena->allocate(previous.size() + 1, 1));
+        previous.copy(copy, previous.size());
+        misordered.push_back({ table.type, table.number, string_view(copy, previous.size()) });
+    };
+
+    for (const auto& table : tables) {
+        auto prev = find_if(state.entries.begin(), state.entries.end(), [&](const auto& entry) {
+            return entry.type == table.type;
+            });
+        if (prev == state.entries.end()) {
+            // Номер "0" — для сравнения с первой подписью.
+            prev = state.entries.insert(state.entries.end(), { table.type, "0", false });
+        }
+
+        if (table.role == CaptionRole::Start) {
+            if (compareCaptionNumbers(table.number, prev->number) <= 0)
+                report(table, prev->number);
+            prev->number.assign(table.number);
+            prev->closed = false;
+        }
+        else {
+            if (prev->closed || compareCaptionNumbers(table.number, prev->number) != 0)
+                report(table, prev->number);
+            if (table.role == CaptionRole::End)
+                prev->closed = true;
+        }
+    }
+
+    return misordered;
+}
+
+
+/**
+ * @struct Options
+ * @brief Параметры запуска, заданные в командной строке.
+ *
+ * @var Options::images
+ * Пути к распознаваемым изображениям страниц в порядке документа.
+ * @var Options::stripWorkers
+ * Число параллельных экземпляров Tesseract для распознавания страницы полосами
+ * (0 или 1 — страница распознаётся целиком).
+ * @var Options::skipBlank
+ * Пропускать ли распознавание страниц, на которых не может быть подписи.
+ * @var Options::detectTables
+ * Искать таблицы по линиям разметки и распознавать только полосы подписей рядом с ними.
+ * @var Options::cellFormat
+ * Формат выгрузки содержимого ячеек таблиц: "csv", "json" или пусто (не выгружать).
+ * @var Options::workers
+ * Число экземпляров Tesseract в пуле для параллельного распознавания ячеек.
+ * @var Options::mosaicPages
+ * Сколько страниц собирать в пакет, подписи которого распознаются одной мозаикой
+ * (0 — подписи распознаются по отдельности на каждой странице).
+ * @var Options::spotKeywords
+ * Искать слово «Таблица»/«Table» по форме и распознавать только найденные строки
+ * (если не включён поиск таблиц по линиям).
+ * @var Options::spotTemplates
+ * Каталог с образцами слова «Таблица», вырезанными из сканов.
+ * @var Options::keywordErrors
+ * Допустимое число ошибок распознавания в ключевом слове подписи.
+ * @var Options::keywords
+ * Ключевые слова подписей в виде «слово», «слово=тип» или «слово=тип:роль».
+ * @var Options::glyphChoices
+ * Исправлять номера подписей по цифрам из альтернатив распознавания символов.
+ * @var Options::reorderPages
+ * Восстанавливать порядок страниц по номерам в колонтитулах перед проверкой нумерации.
+ * @var Options::pageWorkers
+ * Число страниц, распознаваемых одновременно; у каждого потока свои экземпляры Tesseract.
+ * @var Options::largestFirst
+ * Начинать с самых больших файлов, чтобы в конце пакета оставались короткие страницы.
+ * @var Options::ompThreads
+ * Предел потоков OpenMP внутри Tesseract на каждый поток распознавания (0 — не ограничивать);
+ * задаётся в окружении нового процесса (ompEnvironment).
+ * @var Options::autoSplit
+ * Подобрать число потоков страниц и потоков OpenMP пробным прогоном (не вместе с ompThreads).
+ * @var Options::reportTime
+ * Вывести время обработки страниц.
+ * @var Options::arguments
+ * Параметры командной строки, кроме изображений и распределения потоков, для пробных прогонов.
+ * @var Options::pinWorkers
+ * Закреплять потоки страниц за ядрами, распределяя их по узлам NUMA.
+ * @var Options::processes
+ * Число дочерних процессов распознавания (0 — распознавать в этом процессе).
+ * @var Options::serve
+ * Режим дочернего процесса: пути страниц читаются из stdin, результаты пишутся в stdout.
+ * Пул ячеек (workers) родитель делит между процессами (processPagesInProcesses).
+ * @var Options::pageDeadline
+ * Предельное время распознавания страницы в миллисекундах (0 — без ограничения).
+ * @var Options::timeoutPolicy
+ * Что делать со страницей, не уложившейся в срок: "downscale" — повторить в
+ * половинном масштабе, "skip" — пропустить.
+ * @var Options::journalPath
+ * Журнал обработанных страниц для продолжения прерванного запуска (пусто — не вести).
+ * @var Options::memoryBudget
+ * Предел оценки памяти одновременно распознаваемых страниц в байтах (0 — без предела).
+ * @var Options::targetDpi
+ * Разрешение, к которому уменьшаются страницы с более высоким (0 — не уменьшать).
+ * @var Options::costLogPath
+ * Файл, в который дописываются признаки и время распознавания страниц (пусто — не вести).
+ * @var Options::costModelPath
+ * Файл модели стоимости страниц для порядка обработки и прогноза времени.
+ * @var Options::fitCostLog
+ * Журнал признаков, по которому строится модель costModelPath; страницы не обрабатываются.
+ */
+struct Options {
+    vector<string> images;
+    int stripWorkers = 0;
+    bool skipBlank = true;
+    bool detectTables = false;
+    string cellFormat;
+    int workers = max(1, int(thread::hardware_concurrency()));
+    int mosaicPages = 0;
+    bool spotKeywords = false;
+    string spotTemplates;
+    int keywordErrors = defaultKeywordErrors;
+    vector<string> keywords = { "Таблица", "Table=Таблица", "Рисунок", "Figure=Рисунок", "Приложение", "Формула",
+        "Продолжение таблицы=Таблица:cont", "Окончание таблицы=Таблица:end" };
+    bool glyphChoices = false;
+    bool reorderPages = false;
+    int pageWorkers = 1;
+    bool largestFirst = false;
+    int ompThreads = 0;
+    bool autoSplit = false;
+    bool reportTime = false;
+    vector<string> arguments;
+    bool pinWorkers = false;
+    int processes = 0;
+    bool serve = false;
+    int pageDeadline = 0;
+    string timeoutPolicy = "downscale";
+    string journalPath;
+    size_t memoryBudget = 0;
+    int targetDpi = 0;
+    string costLogPath;
+    string costModelPath;
+    string fitCostLog;
+};
+
+/**
+ * @brief Разбирает аргументы командной строки.
+ * @param argc Количество аргументов.
+ * @param argv Аргументы.
+ * @param options Заполняемые параметры.
+ * @return true, если аргументы корректны.
+ */
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const int first = i;
+        string arg = argv[i];
+        if (arg == "--strips" && i + 1 < argc) {
+            options.stripWorkers = atoi(argv[++i]);
+            if (options.stripWorkers < 0) {
+                cerr << "Ошибка: число полос должно быть неотрицательным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--tables") {
+            options.detectTables = true;
+        }
+        else if (arg == "--cells" && i + 1 < argc) {
+            options.cellFormat = argv[++i];
+            options.detectTables = true;
+            if (options.cellFormat != "csv" && options.cellFormat != "json") {
+                cerr << "Ошибка: формат ячеек должен быть csv или json." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--workers" && i + 1 < argc) {
+            options.workers = atoi(argv[++i]);
+            if (options.workers < 1) {
+                cerr << "Ошибка: число потоков должно быть положительным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--mosaic" && i + 1 < argc) {
+            options.mosaicPages = atoi(argv[++i]);
+            options.detectTables = true;
+            if (options.mosaicPages < 1) {
+                cerr << "Ошибка: размер пакета мозаики должен быть положительным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--spot") {
+            options.spotKeywords = true;
+        }
+        else if (arg == "--spot-templates" && i + 1 < argc) {
+            options.spotTemplates = argv[++i];
+            options.spotKeywords = true;
+        }
+        else if (arg == "--fuzzy" && i + 1 < argc) {
+            options.keywordErrors = atoi(argv[++i]);
+            if (options.keywordErrors < 0 || options.keywordErrors > 3) {
+                cerr << "Ошибка: число ошибок в ключевом слове должно быть от 0 до 3." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--keywords" && i + 1 < argc) {
+            options.keywords.clear();
+            stringstream list(argv[++i]);
+            string keyword;
+            while (getline(list, keyword, ',')) {
+                if (keyword.empty())
+                    continue;
+                // Пустое слово («=Таблица») не из чего искать.
+                if (keyword.find('=') == 0) {
+                    cerr << "Ошибка: пустое ключевое слово в " << keyword << endl;
+                    return false;
+                }
+                options.keywords.push_back(keyword);
+            }
+            if (options.keywords.empty()) {
+                cerr << "Ошибка: список ключевых слов пуст." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--glyph-choices") {
+            options.glyphChoices = true;
+        }
+        else if (arg == "--keep-blank") {
+            options.skipBlank = false;
+        }
+        else if (arg == "--reorder") {
+            options.reorderPages = true;
+        }
+        else if (arg == "--page-workers" && i + 1 < argc) {
+            options.pageWorkers = atoi(argv[++i]);
+            if (options.pageWorkers < 1) {
+                cerr << "Ошибка: число потоков страниц должно быть положительным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--largest-first") {
+            options.largestFirst = true;
+        }
+        else if (arg == "--omp-threads" && i + 1 < argc) {
+            options.ompThreads = atoi(argv[++i]);
+            if (options.ompThreads < 1) {
+                cerr << "Ошибка: число потоков OpenMP должно быть положительным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--auto-split") {
+            options.autoSplit = true;
+        }
+        else if (arg == "--report-time") {
+            options.reportTime = true;
+        }
+        else if (arg == "--pin") {
+            options.pinWorkers = true;
+        }
+        else if (arg == "--processes" && i + 1 < argc) {
+            options.processes = atoi(argv[++i]);
+            if (options.processes < 1) {
+                cerr << "Ошибка: число процессов должно быть положительным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--serve") {
+            options.serve = true;
+        }
+        else if (arg == "--deadline" && i + 1 < argc) {
+            options.pageDeadline = atoi(argv[++i]);
+            if (options.pageDeadline < 0) {
+                cerr << "Ошибка: срок распознавания страницы должен быть неотрицательным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--memory-budget" && i + 1 < argc) {
+            const long long megabytes = atoll(argv[++i]);
+            if (megabytes < 0) {
+                cerr << "Ошибка: бюджет памяти должен быть неотрицательным." << endl;
+                return false;
+            }
+            options.memoryBudget = size_t(megabytes) << 20;
+        }
+        else if (arg == "--normalize-dpi" && i + 1 < argc) {
+            options.targetDpi = atoi(argv[++i]);
+            if (options.targetDpi < 0) {
+                cerr << "Ошибка: разрешение должно быть неотрицательным." << endl;
+                return false;
+            }
+        }
+        else if (arg == "--cost-log" && i + 1 < argc) {
+            options.costLogPath = argv[++i];
+        }
+        else if (arg == "--cost-model" && i + 1 < argc) {
+            options.costModelPath = argv[++i];
+        }
+        else if (arg == "--fit-cost-model" && i + 1 < argc) {
+            options.fitCostLog = argv[++i];
+        }
+        else if (arg == "--journal" && i + 1 < argc) {
+            options.journalPath = argv[++i];
+        }
+        else if (arg == "--on-timeout" && i + 1 < argc) {
+            options.timeoutPolicy = argv[++i];
+            if (options.timeoutPolicy != "downscale" && options.timeoutPolicy != "skip") {
+                cerr << "Ошибка: --on-timeout должен быть downscale или skip." << endl;
+                return false;
+            }
+        }
+        else if (!arg.empty() && arg[0] != '-') {
+            options.images.push_back(arg);
+        }
+        else {
+            cerr << "Ошибка: неизвестный параметр " << arg << endl;
+            return false;
+        }
+
+        const bool splitOption = arg == "--page-workers" || arg == "--omp-threads" || arg == "--auto-split"
+            || arg == "--report-time" || arg == "--pin" || arg == "--processes" || arg == "--serve"
+            || arg == "--journal" || arg == "--cost-log" || arg == "--cost-model" || arg == "--fit-cost-model";
+        if (arg[0] == '-' && !splitOption)
+            options.arguments.insert(options.arguments.end(), argv + first, argv + i + 1);
+    }
+    if (options.images.empty())
+        options.images.push_back("4_1.png");
+    if ((options.pageWorkers > 1 || options.processes > 0) && options.mosaicPages > 0) {
+        cerr << "Ошибка: --page-workers и --processes нельзя сочетать с --mosaic." << endl;
+        return false;
+    }
+    if (options.pageWorkers > 1 && options.processes > 0) {
+        cerr << "Ошибка: --page-workers нельзя сочетать с --processes." << endl;
+        return false;
+    }
+    if (!options.fitCostLog.empty() && options.costModelPath.empty()) {
+        cerr << "Ошибка: для --fit-cost-model нужен --cost-model с путём к создаваемой модели." << endl;
+        return false;
+    }
+    return true;
+}
+
+const char* tessdata_path = "E:/vcpkg/installed/x64-windows/share/tessdata/";
+
+/**
+ * @brief Читает файл модели Tesseract через отображение в память, общее для всех экземпляров.
+ *
+ * Tesseract вызывает эту функцию вместо чтения с диска для каждого файла
+ * traineddata. Файл отображается в память один раз за процесс и остаётся
+ * отображённым до конца работы, так что диск читается один раз, а
+ * страницы файла в кэше Windows общие для всех процессов GetTable.
+ * Интерфейс FileReader требует копии в data, поэтому веса по-прежнему
+ * лежат в памяти каждого экземпляра; копия делается потоком, создающим
+ * экземпляр, то есть на его узле NUMA.
+ *
+ * @param filename Путь к файлу.
+ * @param data Содержимое файла.
+ * @return false, если файл не удалось прочитать.
+ */
+bool readMappedFile(const char* filename, vector<char>* data) {
+    static mutex lock;
+    static unordered_map<string, string_view> views;
+
+    string_view view;
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = views.find(filename);
+        if (it == views.end()) {
+            HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER size = {};
+            HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0
+                ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+            const void* bytes = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            // Представление держит отображение открытым и после закрытия описателей.
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            if (!bytes)
+                return false;
+            it = views.emplace(filename, string_view(static_cast<const char*>(bytes), size_t(size.QuadPart))).first;
+        }
+        view = it->second;
+    }
+
+    data->assign(view.begin(), view.end());
+    return true;
+}
+
+/**
+ * @struct ImageInfo
+ * @brief Сведения об изображении из заголовка файла.
+ *
+ * @var ImageInfo::format
+ * "png", "jpeg" или "tiff".
+ * @var ImageInfo::dpi
+ * Разрешение по вертикали в точках на дюйм или 0, если не указано.
+ * @var ImageInfo::bitDepth
+ * Бит на отсчёт канала (1 у факсовых TIFF).
+ * @var ImageInfo::colour
+ * Цветное изображение (в том числе с палитрой); иначе серое или чёрно-белое.
+ * @var ImageInfo::pages
+ * Число страниц (кадров) в файле; больше одной бывает у TIFF.
+ */
+struct ImageInfo {
+    string format;
+    cv::Size size;
+    double dpi = 0;
+    int bitDepth = 8;
+    bool colour = true;
+    int pages = 1;
+};
+
+/**
+ * @brief Разбирает заголовок PNG: IHDR и pHYs до первого блока данных.
+ */
+bool probePng(ifstream& in, ImageInfo& info) {
+    auto be32 = [](const unsigned char* p) { return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]; };
+    in.seekg(8);
+    unsigned char chunk[8];
+    while (in.read(reinterpret_cast<char*>(chunk), sizeof(chunk))) {
+        const uint32_t length = be32(chunk);
+        const string type(reinterpret_cast<const char*>(chunk + 4), 4);
+        if (type == "IDAT" || type == "IEND")
+            break;
+        unsigned char data[13];
+        if (type == "IHDR" && length == 13 && in.read(reinterpret_cast<char*>(data), 13)) {
+            info.size = cv::Size(int(be32(data)), int(be32(data + 4)));
+            info.bitDepth = data[8];
+            // Тип цвета 0 — серое, 4 — серое с прозрачностью; 2, 3 (палитра) и 6 — цветные.
+            info.colour = data[9] != 0 && data[9] != 4;
+            in.seekg(4, ios::cur);
+            continue;
+        }
+        if (type == "pHYs" && length == 9 && in.read(reinterpret_cast<char*>(data), 9)) {
+            // Единица 1 — точки на метр.
+            if (data[8] == 1)
+                info.dpi = be32(data + 4) * 0.0254;
+            in.seekg(4, ios::cur);
+            continue;
+        }
+        in.seekg(streamoff(length) + 4, ios::cur);
+    }
+    return info.size.width > 0 && info.size.height > 0;
+}
+
+/**
+ * @brief Разбирает заголовок JPEG: плотность JFIF и кадр SOF; сжатые данные не читаются.
+ */
+bool probeJpeg(ifstream& in, ImageInfo& info) {
+    auto be16 = [](const unsigned char* p) { return int(p[0]) << 8 | p[1]; };
+    in.seekg(2);
+    unsigned char marker[4];
+    while (in.read(reinterpret_cast<char*>(marker), sizeof(marker))) {
+        if (marker[0] != 0xFF)
+            return false;
+        // Маркеру могут предшествовать байты заполнения 0xFF.
+        if (marker[1] == 0xFF) {
+            in.seekg(-3, ios::cur);
+            continue;
+        }
+        const int type = marker[1];
+        const int length = be16(marker + 2);
+        if (length < 2 || type == 0xDA || type == 0xD9)
+            return false;
+        const streampos next = in.tellg() + streamoff(length - 2);
+
+        unsigned char data[14];
+        const bool frame = type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC;
+        if (frame) {
+            if (!in.read(reinterpret_cast<char*>(data), 6))
+                return false;
+            info.bitDepth = data[0];
+            info.size = cv::Size(be16(data + 3), be16(data + 1));
+            info.colour = data[5] >= 3;
+            return info.size.width > 0 && info.size.height > 0;
+        }
+        if (type == 0xE0 && length >= 16 && in.read(reinterpret_cast<char*>(data), 12)
+            && memcmp(data, "JFIF\0", 5) == 0) {
+            // Единица плотности: 1 — точки на дюйм, 2 — точки на сантиметр.
+            const int density = be16(data + 10);
+            if (data[7] == 1)
+                info.dpi = density;
+            else if (data[7] == 2)
+                info.dpi = density * 2.54;
+        }
+        in.seekg(next);
+    }
+    return false;
+}
+
+/**
+ * @brief Разбирает заголовок TIFF: теги первого IFD и цепочку IFD для числа страниц.
+ */
+bool probeTiff(ifstream& in, bool bigEndian, ImageInfo& info) {
+    auto u16 = [&](const unsigned char* p) { return bigEndian ? uint32_t(p[0]) << 8 | p[1] : uint32_t(p[1]) << 8 | p[0]; };
+    auto u32 = [&](const unsigned char* p) {
+        return bigEndian ? uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]
+                         : uint32_t(p[3]) << 24 | uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 | p[0];
+    };
+    auto readAt = [&](uint32_t offset, unsigned char* data, size_t size) {
+        in.clear();
+        in.seekg(offset);
+        return bool(in.read(reinterpret_cast<char*>(data), size));
+    };
+
+    unsigned char word[8];
+    if (!readAt(4, word, 4))
+        return false;
+    uint32_t offset = u32(word);
+    double resolution = 0;
+    int unit = 2;
+    int photometric = -1;
+    int samples = 1;
+    info.pages = 0;
+    // Цепочка IFD может быть зациклена в повреждённом файле.
+    while (offset != 0 && info.pages < 65536) {
+        if (!readAt(offset, word, 2))
+            break;
+        const uint32_t count = u16(word);
+        if (info.pages++ > 0) {
+            if (!readAt(offset + 2 + count * 12, word, 4) || u32(word) <= offset)
+                break;
+            offset = u32(word);
+            continue;
+        }
+
+        for (uint32_t k = 0; k < count; ++k) {
+            unsigned char entry[12];
+            if (!readAt(offset + 2 + k * 12, entry, sizeof(entry)))
+                return false;
+            const uint32_t tag = u16(entry);
+            const uint32_t type = u16(entry + 2);
+            const uint32_t values = u32(entry + 4);
+            // Короткие значения лежат в начале поля, длинные — по смещению.
+            const uint32_t value = type == 3 ? u16(entry + 8) : u32(entry + 8);
+            switch (tag) {
+            case 256: info.size.width = int(value); break;
+            case 257: info.size.height = int(value); break;
+            case 258:
+                if (values <= 2)
+                    info.bitDepth = int(value);
+                else if (readAt(value, word, 2))
+                    info.bitDepth = int(u16(word));
+                break;
+            case 262: photometric = int(value); break;
+            case 277: samples = int(value); break;
+            case 283:
+                if (type == 5 && readAt(value, word, 8) && u32(word + 4) != 0)
+                    resolution = double(u32(word)) / u32(word + 4);
+                break;
+            case 296: unit = int(value); break;
+            }
+        }
+        if (!readAt(offset + 2 + count * 12, word, 4) || u32(word) <= offset)
+            break;
+        offset = u32(word);
+    }
+
+    // Фотометрия 0 и 1 — чёрно-белое или серое, 3 — палитра.
+    info.colour = samples >= 3 || photometric == 3 || photometric == 2;
+    if (unit == 2)
+        info.dpi = resolution;
+    else if (unit == 3)
+        info.dpi = resolution * 2.54;
+    return info.pages > 0 && info.size.width > 0 && info.size.height > 0;
+}
+
+/**
+ * @brief Читает сведения об изображении из заголовка файла, не декодируя его.
+ *
+ * Разбираются PNG (IHDR, pHYs), JPEG (JFIF, SOF) и TIFF (первый IFD и
+ * цепочка IFD); читаются только заголовки, поэтому проба занимает
+ * микросекунды даже на чертежах формата A0.
+ *
+ * @param path Путь к изображению.
+ * @param info Сведения об изображении.
+ * @return false, если формат не распознан или заголовок повреждён.
+ */
+bool probeImage(const string& path, ImageInfo& info) {
+    ifstream in(path, ios::binary);
+    unsigned char head[8];
+    if (!in.read(reinterpret_cast<char*>(head), sizeof(head)))
+        return false;
+
+    info = ImageInfo();
+    if (memcmp(head, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        info.format = "png";
+        return probePng(in, info);
+    }
+    if (head[0] == 0xFF && head[1] == 0xD8) {
+        info.format = "jpeg";
+        return probeJpeg(in, info);
+    }
+    if (memcmp(head, "II*\0", 4) == 0 || memcmp(head, "MM\0*", 4) == 0) {
+        info.format = "tiff";
+        return probeTiff(in, head[0] == 'M', info);
+    }
+    return false;
+}
+
+/**
+ * Оценка памяти на пиксель распознаваемой страницы сверх самого изображения:
+ * серая и бинарная копии подготовки, Pix Tesseract с порогами и строками LSTM.
+ */
+const size_t pageWorkBytesPerPixel = 9;
+
+/**
+ * @struct PageRead
+ * @brief Как читать изображение страницы, по сведениям из заголовка.
+ *
+ * @var PageRead::reduction
+ * Уменьшение при декодировании: 1, 2, 4 или 8.
+ * @var PageRead::grayscale
+ * Читать одноканальным: страница серая или чёрно-белая.
+ * @var PageRead::dpi
+ * Разрешение прочитанного изображения или 0, если неизвестно.
+ * @var PageRead::footprint
+ * Оценка памяти на распознавание страницы; без сведений — весь бюджет.
+ * @var PageRead::overBudget
+ * Страница уменьшена сверх нормализации разрешения, чтобы уложиться в бюджет памяти.
+ * @var PageRead::pages
+ * Число страниц в файле.
+ * @var PageRead::size
+ * Размеры прочитанного изображения или пустой размер, если заголовок не разобран.
+ */
+struct PageRead {
+    cv::Size size;
+    int reduction = 1;
+    bool grayscale = false;
+    int dpi = 0;
+    size_t footprint = 0;
+    bool overBudget = false;
+    int pages = 1;
+};
+
+/**
+ * @brief Выбирает способ чтения страницы по её заголовку.
+ *
+ * Серые и чёрно-белые (факсовые) изображения читаются одноканальными:
+ * обработка и так переводит страницу в серое, а буфер втрое меньше.
+ * С --normalize-dpi страница с разрешением заметно выше заданного
+ * уменьшается при декодировании, пока разрешение не опустится к заданному:
+ * подписи на 600 точках на дюйм читаются так же, как на 300, а памяти и
+ * времени нужно вчетверо меньше. Затем уменьшение увеличивается, пока
+ * оценка памяти не уложится в бюджет.
+ *
+ * @param options Параметры запуска.
+ * @param path Путь к изображению.
+ * @param minReduction Наименьшее уменьшение (выбранное родительским процессом).
+ * @return Способ чтения.
+ */
+PageRead planPageRead(const Options& options, const string& path, int minReduction) {
+    PageRead plan;
+    plan.reduction = minReduction;
+    ImageInfo info;
+    if (!probeImage(path, info)) {
+        plan.footprint = options.memoryBudget;
+        return plan;
+    }
+
+    plan.grayscale = !info.colour;
+    plan.pages = info.pages;
+    int normalized = 1;
+    while (options.targetDpi > 0 && normalized < 8 && info.dpi / (normalized * 2) >= options.targetDpi * 0.9)
+        normalized *= 2;
+    plan.reduction = max(plan.reduction, normalized);
+
+    const size_t bytesPerPixel = pageWorkBytesPerPixel + (plan.grayscale ? 1 : 3);
+    auto footprint = [&](int r) { return size_t(info.size.width / r) * size_t(info.size.height / r) * bytesPerPixel; };
+    while (options.memoryBudget > 0 && plan.reduction < 8 && footprint(plan.reduction) > options.memoryBudget)
+        plan.reduction *= 2;
+    plan.overBudget = plan.reduction > normalized;
+    plan.footprint = footprint(plan.reduction);
+    plan.dpi = int(lround(info.dpi / plan.reduction));
+    plan.size = cv::Size(info.size.width / plan.reduction, info.size.height / plan.reduction);
+    return plan;
+}
+
+/**
+ * @brief Читает изображение страницы, уменьшая его при декодировании.
+ *
+ * Декодер JPEG уменьшает изображение сам, не разворачивая полный кадр;
+ * остальные форматы OpenCV уменьшает сразу после декодирования.
+ *
+ * @param path Путь к изображению.
+ * @param plan Способ чтения.
+ * @return Изображение или пустая матрица, если оно не загрузилось.
+ */
+cv::Mat readPage(const string& path, const PageRead& plan) {
+    const bool gray = plan.grayscale;
+    switch (plan.reduction) {
+    case 2: return cv::imread(path, gray ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2);
+    case 4: return cv::imread(path, gray ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4);
+    case 8: return cv::imread(path, gray ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8);
+    default: return cv::imread(path, gray ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+    }
+}
+
+/**
+ * @brief Создаёт и инициализирует экземпляр Tesseract.
+ * @param options Параметры запуска.
+ * @return Готовый к работе экземпляр или nullptr при ошибке инициализации.
+ */
+unique_ptr<tesseract::TessBaseAPI> createOcrEngine(const Options& options) {
+    auto ocr = make_unique<tesseract::TessBaseAPI>();
+    if (ocr->Init(tessdata_path, 0, "eng+rus", tesseract::OEM_LSTM_ONLY, nullptr, 0, nullptr, nullptr, false,
+        readMappedFile))
+        return nullptr;
+    // Альтернативы символов LSTM нужны только recognizeLines с glyphChoices.
+    if (options.glyphChoices)
+        ocr->SetVariable("lstm_choice_mode", "2");
+    return ocr;
+}
+
+/**
+ * @brief Переводит изображение в оттенки серого без копирования, если оно уже одноканальное.
+ * @param img Исходное изображение.
+ * @return Одноканальное изображение.
+ */
+cv::Mat toGray(const cv::Mat& img) {
+    if (img.channels() == 1)
+        return img;
+    cv::Mat gray;
+    cv::cvtColor(img, gray, img.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+    return gray;
+}
+
+/**
+ * @struct InkStats
+ * @brief Статистика чернил на странице для отбраковки пустых страниц.
+ *
+ * @var InkStats::inkRatio
+ * Доля тёмных пикселей.
+ * @var InkStats::glyphComponents
+ * Число связных компонент, по размеру похожих на символы текста.
+ */
+struct InkStats {
+    double inkRatio = 0;
+    int glyphComponents = 0;
+};
+
+/** Наименьшая высота символа в пикселях исходного изображения: мельче распознавание всё равно не прочтёт. */
+const int minGlyphHeight = 8;
+
+/**
+ * @brief Быстро оценивает наличие текста на странице.
+ *
+ * Страница уменьшается до ~1000 пикселей по длинной стороне, но не больше
+ * чем вчетверо, тёмные пиксели отделяются порогом относительно средней
+ * яркости бумаги, затем считаются связные компоненты размером с символ.
+ * Наименьшая высота символа задаётся в пикселях исходного изображения, а
+ * не долей страницы: на чертеже A0 надпись высотой 3,5 мм — около трёхсотой
+ * доли листа, но при 300 точках на дюйм это 40 пикселей.
+ * Все операции векторизованы OpenCV.
+ *
+ * @param img Изображение страницы.
+ * @return Статистика чернил.
+ */
+InkStats measureInk(const cv::Mat& img) {
+    cv::Mat gray = toGray(img);
+    const int longSide = max(gray.cols, gray.rows);
+    // При уменьшении сильнее чем вчетверо мелкий текст больших форматов сливается в точки.
+    const double scale = longSide > 1000 ? max(1000.0 / longSide, 0.25) : 1.0;
+    if (scale < 1.0)
+        cv::resize(gray, gray, cv::Size(), scale, scale, cv::INTER_AREA);
+
+    // Чернила — пиксели заметно темнее бумаги; фиксированный порог не подходит для сероватых сканов.
+    const double paper = cv::mean(gray)[0];
+    cv::Mat ink;
+    cv::threshold(gray, ink, paper * 0.6, 255, cv::THRESH_BINARY_INV);
+
+    InkStats stats;
+    stats.inkRatio = double(cv::countNonZero(ink)) / gray.total();
+    if (stats.inkRatio == 0)
+        return stats;
+
+    cv::Mat labels, components, centroids;
+    int count = cv::connectedComponentsWithStats(ink, labels, components, centroids, 8, CV_32S);
+    const int minHeight = max(2, int(lround(minGlyphHeight * scale)));
+    const int maxHeight = gray.rows / 20;
+    const int maxWidth = gray.cols / 5;
+    for (int label = 1; label < count; ++label) {
+        const int* c = components.ptr<int>(label);
+        if (c[cv::CC_STAT_HEIGHT] >= minHeight && c[cv::CC_STAT_HEIGHT] <= maxHeight
+            && c[cv::CC_STAT_WIDTH] <= maxWidth && c[cv::CC_STAT_AREA] >= 4)
+            ++stats.glyphComponents;
+    }
+    return stats;
+}
+
+/**
+ * @brief Решает, может ли на странице быть подпись таблицы.
+ * @param stats Статистика чернил страницы.
+ * @param reason Причина пропуска, если страница отбракована.
+ * @return true, если страницу нужно распознавать.
+ */
+bool mayContainCaption(const InkStats& stats, string& reason) {
+    if (stats.inkRatio < 0.001) {
+        reason = "пустая страница";
+        return false;
+    }
+    // Подпись «Таблица N» — это не меньше 7 символов.
+    if (stats.glyphComponents < 7) {
+        reason = "нет текста";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @struct TableRegion
+ * @brief Таблица, найденная по линиям разметки, и полосы поиска её подписи.
+ *
+ * @var TableRegion::box
+ * Рамка таблицы.
+ * @var TableRegion::captionAbove
+ * Полоса над таблицей, где по ГОСТ располагается подпись.
+ * @var TableRegion::captionBelow
+ * Полоса под таблицей для документов с подписью снизу.
+ * @var TableRegion::rowLines
+ * Координаты y горизонтальных линий сетки сверху вниз.
+ * @var TableRegion::colLines
+ * Координаты x вертикальных линий сетки слева направо.
+ */
+struct TableRegion {
+    cv::Rect box;
+    cv::Rect captionAbove;
+    cv::Rect captionBelow;
+    vector<int> rowLines;
+    vector<int> colLines;
+};
+
+/**
+ * @brief Находит координаты линий сетки по маске линий одного направления.
+ * @param mask Маска линий в пределах таблицы.
+ * @param horizontal true для горизонтальных линий (возвращаются y), false для вертикальных (x).
+ * @param offset Смещение таблицы на странице по той же оси.
+ * @return Центры линий в координатах страницы.
+ */
+vector<int> findGridLines(const cv::Mat& mask, bool horizontal, int offset) {
+    cv::Mat counts;
+    cv::reduce(mask, counts, horizontal ? 1 : 0, cv::REDUCE_SUM, CV_32S);
+
+    // Линией считается ряд, покрытый маской хотя бы на половину размера таблицы.
+    const int length = horizontal ? mask.cols : mask.rows;
+    const int positions = horizontal ? mask.rows : mask.cols;
+    vector<int> lines;
+    int runStart = -1;
+    for (int p = 0; p <= positions; ++p) {
+        bool onLine = p < positions && counts.at<int>(p) / 255 * 2 >= length;
+        if (onLine && runStart < 0)
+            runStart = p;
+        else if (!onLine && runStart >= 0) {
+            lines.push_back(offset + (runStart + p) / 2);
+            runStart = -1;
+        }
+    }
+    return lines;
+}
+
+/**
+ * @brief Находит таблицы по горизонтальным и вертикальным линиям разметки.
+ *
+ * Линии выделяются морфологическим размыканием бинаризованной страницы
+ * длинными горизонтальным и вертикальным ядрами, их объединение
+ * группируется в контуры, и рамки контуров, содержащие линии обоих
+ * направлений, считаются таблицами.
+ *
+ * Берутся внешние границы всех связных областей, в том числе лежащих
+ * внутри других: на листе в рамке по ГОСТ таблицы находятся внутри рамки.
+ * Сама рамка (область почти во всю страницу или содержащая другие
+ * таблицы) таблицей не считается.
+ *
+ * @param img Изображение страницы.
+ * @return Таблицы в порядке сверху вниз.
+ */
+vector<TableRegion> detectTables(const cv::Mat& img) {
+    cv::Mat binary;
+    cv::adaptiveThreshold(toGray(img), binary, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 15, 10);
+
+    cv::Mat horizontal, vertical;
+    cv::morphologyEx(binary, horizontal, cv::MORPH_OPEN,
+        cv::getStructuringElement(cv::MORPH_RECT, cv::Size(max(10, img.cols / 30), 1)));
+    cv::morphologyEx(binary, vertical, cv::MORPH_OPEN,
+        cv::getStructuringElement(cv::MORPH_RECT, cv::Size(1, max(10, img.rows / 60))));
+
+    cv::Mat grid;
+    cv::bitwise_or(horizontal, vertical, grid);
+    // Небольшое расширение сшивает разрывы линий на стыках и после сканирования.
+    cv::dilate(grid, grid, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
+
+    // В двухуровневой иерархии внешние границы областей — контуры без родителя, а отверстия (ячейки) — их дети.
+    vector<vector<cv::Point>> contours;
+    vector<cv::Vec4i> hierarchy;
+    cv::findContours(grid, contours, hierarchy, cv::RETR_CCOMP, cv::CHAIN_APPROX_SIMPLE);
+
+    vector<cv::Rect> boxes;
+    for (size_t i = 0; i < contours.size(); ++i) {
+        if (hierarchy[i][3] >= 0)
+            continue;
+        cv::Rect box = cv::boundingRect(contours[i]);
+        if (box.width < img.cols / 10 || box.height < img.rows / 50)
+            continue;
+        if (cv::countNonZero(horizontal(box)) == 0 || cv::countNonZero(vertical(box)) == 0)
+            continue;
+        boxes.push_back(box);
+    }
+
+    vector<TableRegion> tables;
+    for (const cv::Rect& box : boxes) {
+        const bool pageFrame = box.width >= img.cols * 0.85 && box.height >= img.rows * 0.85;
+        const bool enclosing = any_of(boxes.begin(), boxes.end(), [&](const cv::Rect& other) {
+            return other != box && (box & other) == other;
+            });
+        if (pageFrame || enclosing)
+            continue;
+        tables.push_back({ box, {}, {},
+            findGridLines(horizontal(box), true, box.y), findGridLines(vertical(box), false, box.x) });
+    }
+    sort(tables.begin(), tables.end(), [](const TableRegion& a, const TableRegion& b) {
+        return a.box.y < b.box.y;
+        });
+
+    // Полосы подписей не заходят на соседние таблицы.
+    const int aboveHeight = max(60, img.rows / 12);
+    const int belowHeight = max(40, img.rows / 24);
+    const cv::Rect page(0, 0, img.cols, img.rows);
+    for (size_t i = 0; i < tables.size(); ++i) {
+        const cv::Rect& box = tables[i].box;
+        int top = max(box.y - aboveHeight, i > 0 ? tables[i - 1].box.br().y : 0);
+        int bottom = min(box.br().y + belowHeight, i + 1 < tables.size() ? tables[i + 1].box.y : img.rows);
+        tables[i].captionAbove = cv::Rect(0, top, img.cols, box.y - top) & page;
+        tables[i].captionBelow = cv::Rect(0, box.br().y, img.cols, bottom - box.br().y) & page;
+    }
+    return tables;
+}
+
+/**
+ * @struct PageDeadline
+ * @brief Срок распознавания страницы, общий для всех вызовов Tesseract по ней.
+ *
+ * Проверяется Tesseract через ETEXT_DESC::cancel между словами, поэтому
+ * один срок ограничивает и полосы, распознаваемые параллельно, и ячейки.
+ * Поле interrupted отмечает, что срок действительно оборвал распознавание:
+ * страница, распознанная вовремя, но разобранная уже после срока, полна.
+ */
+struct PageDeadline {
+    chrono::steady_clock::time_point end;
+    mutable atomic<bool> expired{ false };
+    mutable atomic<bool> interrupted{ false };
+
+    explicit PageDeadline(int milliseconds)
+        : end(chrono::steady_clock::now() + chrono::milliseconds(milliseconds)) {}
+
+    /** @brief Истёк ли срок; после первого истечения время больше не запрашивается. */
+    bool passed() const {
+        if (!expired && chrono::steady_clock::now() >= end)
+            expired = true;
+        return expired;
+    }
+};
+
+/**
+ * @brief Обратный вызов отмены для ETEXT_DESC: прерывает распознавание по истечении срока.
+ * @param deadline Срок страницы (PageDeadline).
+ * @return true, если распознавание нужно прервать.
+ */
+bool cancelAtDeadline(void* deadline, int /*words*/) {
+    const PageDeadline* page = static_cast<const PageDeadline*>(deadline);
+    if (!page->passed())
+        return false;
+    page->interrupted = true;
+    return true;
+}
+
+/**
+ * @brief Распознаёт изображение, уже переданное в Tesseract, с ограничением по сроку.
+ * @param ocr Экземпляр Tesseract с установленным изображением.
+ * @param deadline Срок страницы или nullptr.
+ * @return Код возврата TessBaseAPI::Recognize.
+ */
+int recognizeBefore(tesseract::TessBaseAPI* ocr, const PageDeadline* deadline) {
+    if (!deadline)
+        return ocr->Recognize(nullptr);
+    if (deadline->passed()) {
+        deadline->interrupted = true;
+        return -1;
+    }
+    ETEXT_DESC monitor;
+    monitor.cancel = cancelAtDeadline;
+    monitor.cancel_this = const_cast<PageDeadline*>(deadline);
+    return ocr->Recognize(&monitor);
+}
+
+/**
+ * @brief Распознаёт изображение, уже переданное в Tesseract, построчно с разметкой.
+ *
+ * Строки, блоки и рамки берутся из ResultIterator того же распознавания,
+ * второго прохода OCR не требуется.
+ *
+ * С glyphChoices текст собирается по символам, и у каждого символа,
+ * распознанного не как цифра, в digitChoices запоминается цифра из
+ * альтернатив ChoiceIterator, если она там есть. Текст не меняется:
+ * альтернативы использует только readCaptionNumber в номере подписи, где
+ * «1O» с альтернативой «0» у второго символа читается как «10». Для этого
+ * нужен lstm_choice_mode, который createOcrEngine включает по --glyph-choices.
+ *
+ * @param ocr Экземпляр Tesseract с установленным изображением.
+ * @param glyphChoices Использовать ли альтернативы символов.
+ * @param deadline Срок страницы или nullptr.
+ * @return Строки текста в порядке чтения.
+ */
+vector<OcrLine> recognizeLines(tesseract::TessBaseAPI* ocr, bool glyphChoices, const PageDeadline* deadline = nullptr) {
+    vector<OcrLine> lines;
+    if (recognizeBefore(ocr, deadline) != 0)
+        return lines;
+    unique_ptr<tesseract::ResultIterator> it(ocr->GetIterator());
+    const tesseract::PageIteratorLevel level = glyphChoices ? tesseract::RIL_SYMBOL : tesseract::RIL_TEXTLINE;
+    if (!it || it->Empty(level))
+        return lines;
+
+    int block = -1;
+    do {
+        if (it->IsAtBeginningOf(tesseract::RIL_BLOCK))
+            ++block;
+        if (it->IsAtBeginningOf(tesseract::RIL_TEXTLINE)) {
+            int left, top, right, bottom;
+            it->BoundingBox(tesseract::RIL_TEXTLINE, &left, &top, &right, &bottom);
+            lines.push_back({ {}, cv::Rect(left, top, right - left, bottom - top), max(block, 0) });
+        }
+
+        if (!glyphChoices) {
+            unique_ptr<char[]> lineText(it->GetUTF8Text(tesseract::RIL_TEXTLINE));
+            if (lineText)
+                lines.back().text = lineText.get();
+            continue;
+        }
+
+        OcrLine& line = lines.back();
+        if (it->IsAtBeginningOf(tesseract::RIL_WORD) && !it->IsAtBeginningOf(tesseract::RIL_TEXTLINE))
+            line.text += ' ';
+
+        unique_ptr<char[]> symbol(it->GetUTF8Text(tesseract::RIL_SYMBOL));
+        const string top = symbol ? symbol.get() : "";
+        if (top.size() != 1 || !isdigit(static_cast<unsigned char>(top[0]))) {
+            tesseract::ChoiceIterator choice(*it);
+            do {
+                const char* alternative = choice.GetUTF8Text();
+                if (alternative && alternative[0] && !alternative[1] && isdigit(static_cast<unsigned char>(alternative[0]))) {
+                    line.digitChoices.emplace_back(line.text.size(), alternative[0]);
+                    break;
+                }
+            } while (choice.Next());
+        }
+        line.text += top;
+    } while (it->Next(level));
+
+    for (OcrLine& line : lines)
+        replace(line.text.begin(), line.text.end(), '\n', ' ');
+    return lines;
+}
+
+/**
+ * @brief Распознаёт прямоугольную область страницы, уже переданной в Tesseract.
+ * @param ocr Экземпляр Tesseract с установленным изображением страницы.
+ * @param region Распознаваемая область.
+ * @param glyphChoices Использовать ли альтернативы символов (см. recognizeLines).
+ * @param deadline Срок страницы или nullptr.
+ * @return Строки области с рамками в координатах страницы.
+ */
+vector<OcrLine> recognizeRegion(tesseract::TessBaseAPI* ocr, const cv::Rect& region, bool glyphChoices = false,
+    const PageDeadline* deadline = nullptr) {
+    if (region.empty())
+        return {};
+    ocr->SetRectangle(region.x, region.y, region.width, region.height);
+    return recognizeLines(ocr, glyphChoices, deadline);
+}
+
+/**
+ * @brief Распознаёт номер страницы в колонтитулах.
+ *
+ * Распознаются только полосы высотой 7% страницы снизу и сверху, обрезанные
+ * по рамке чернил, с разрешёнными одними цифрами. В Tesseract передаётся
+ * только вырезанный фрагмент, а не вся страница. Номером считается
+ * последнее отдельное число из 1–4 цифр: нижний колонтитул проверяется
+ * первым, в рамке по ГОСТ номер листа стоит в правом нижнем углу.
+ *
+ * @param ocr Экземпляр Tesseract.
+ * @param img Изображение страницы.
+ * @return Номер страницы или 0, если он не распознан.
+ */
+int recognizePageNumber(tesseract::TessBaseAPI* ocr, const cv::Mat& img) {
+    const int bandHeight = max(1, img.rows * 7 / 100);
+    const cv::Rect bands[] = { cv::Rect(0, img.rows - bandHeight, img.cols, bandHeight),
+        cv::Rect(0, 0, img.cols, bandHeight) };
+
+    const tesseract::PageSegMode savedMode = ocr->GetPageSegMode();
+    ocr->SetPageSegMode(tesseract::PSM_SPARSE_TEXT);
+    ocr->SetVariable("tessedit_char_whitelist", "0123456789");
+
+    int number = 0;
+    for (const cv::Rect& band : bands) {
+        cv::Mat ink;
+        cv::threshold(toGray(img(band)), ink, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+        if (cv::countNonZero(ink) == 0)
+            continue;
+
+        const int pad = 4;
+        cv::Rect box = cv::boundingRect(ink);
+        box = cv::Rect(box.x - pad, box.y - pad, box.width + 2 * pad, box.height + 2 * pad)
+            & cv::Rect(0, 0, band.width, band.height);
+        cv::Mat crop = img(band)(box);
+        ocr->SetImage(crop.data, crop.cols, crop.rows, crop.channels(), crop.step);
+        unique_ptr<char[]> text(ocr->GetUTF8Text());
+        if (!text)
+            continue;
+        istringstream words(text.get());
+        string word;
+        while (words >> word) {
+            if (word.size() <= 4)
+                number = atoi(word.c_str());
+        }
+        if (number > 0)
+            break;
+    }
+
+    ocr->SetVariable("tessedit_char_whitelist", "");
+    ocr->SetPageSegMode(savedMode);
+    return number;
+}
+
+/**
+ * @brief Восстанавливает порядок страниц по номерам в колонтитулах.
+ *
+ * Страницы упорядочиваются по распознанному номеру; страница без номера
+ * (пустая, титульная) остаётся следом за предыдущей по входному порядку
+ * страницей с номером. Страницы с одинаковыми номерами сохраняют входной
+ * порядок. Так исправляются пачки, отсканированные не по порядку или
+ * с двусторонней подачей (1, 3, 5, 6, 4, 2).
+ *
+ * @param options Параметры запуска (чтение страниц).
+ * @param images Пути к изображениям во входном порядке; переупорядочиваются.
+ * @param ocr Экземпляр Tesseract.
+ * @param pageNumbers Распознанные номера страниц по пути к изображению (0 — не распознан).
+ * @return true, если порядок изменился.
+ */
+bool orderPagesByNumber(const Options& options, vector<string>& images, tesseract::TessBaseAPI* ocr,
+    unordered_map<string, int>& pageNumbers) {
+    // Ключ сортировки: номер последней страницы с номером на этом месте или раньше.
+    vector<pair<int, size_t>> keys;
+    int lastNumber = 0;
+    for (size_t i = 0; i < images.size(); ++i) {
+        cv::Mat img = readPage(images[i], planPageRead(options, images[i], 1));
+        const int number = img.empty() ? 0 : recognizePageNumber(ocr, img);
+        pageNumbers[images[i]] = number;
+        if (number > 0)
+            lastNumber = number;
+        keys.emplace_back(lastNumber, i);
+    }
+
+    stable_sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    vector<string> ordered;
+    bool changed = false;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        changed |= keys[i].second != i;
+        ordered.push_back(move(images[keys[i].second]));
+    }
+    images = move(ordered);
+    return changed;
+}
+
+/**
+ * @struct KeywordTemplate
+ * @brief Образец ключевого слова для поиска по форме.
+ *
+ * @var KeywordTemplate::descriptor
+ * Дескриптор профилей слова.
+ * @var KeywordTemplate::aspect
+ * Отношение ширины слова к высоте.
+ */
+struct KeywordTemplate {
+    cv::Mat descriptor;
+    double aspect;
+};
+
+/**
+ * @brief Вычисляет дескриптор профилей слова.
+ *
+ * Слово приводится к 24x64 пикселям, и для каждого столбца берутся доля
+ * чернил, расстояние от верха до первых чернил и от низа до последних.
+ * Такие профили устойчивы к шрифту и толщине штриха и сравниваются
+ * обычным евклидовым расстоянием.
+ *
+ * @param ink Бинарное изображение слова (чернила — 255), обрезанное по рамке.
+ * @return Строка CV_32F с нормированным дескриптором.
+ */
+cv::Mat wordDescriptor(const cv::Mat& ink) {
+    const int height = 24, width = 64;
+    cv::Mat norm;
+    cv::resize(ink, norm, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+
+    cv::Mat descriptor(1, width * 3, CV_32F);
+    float* d = descriptor.ptr<float>();
+    for (int x = 0; x < width; ++x) {
+        int count = 0, upper = height, lower = height;
+        for (int y = 0; y < height; ++y) {
+            if (norm.at<uchar>(y, x) < 128)
+                continue;
+            ++count;
+            if (upper == height)
+                upper = y;
+            lower = height - 1 - y;
+        }
+        d[x] = float(count) / height;
+        d[width + x] = float(upper) / height;
+        d[2 * width + x] = float(lower) / height;
+    }
+    return descriptor;
+}
+
+/**
+ * @brief Обрезает бинарное изображение по рамке чернил и строит образец слова.
+ * @param ink Бинарное изображение (чернила — 255).
+ * @param templates Пополняемый набор образцов.
+ */
+void addKeywordTemplate(const cv::Mat& ink, vector<KeywordTemplate>& templates) {
+    cv::Rect box = cv::boundingRect(ink);
+    if (box.width < 4 || box.height < 4)
+        return;
+    templates.push_back({ wordDescriptor(ink(box)), double(box.width) / box.height });
+}
+
+/**
+ * @brief Рисует слово шрифтом Windows.
+ *
+ * Встроенные шрифты OpenCV не содержат кириллицы, поэтому русские образцы
+ * рисуются через GDI в DIB-секцию.
+ *
+ * @param word Слово в UTF-8.
+ * @param face Имя шрифта.
+ * @param height Высота шрифта в пикселях.
+ * @param bold Полужирное начертание.
+ * @return Бинарное изображение слова (чернила — 255) или пустая матрица.
+ */
+cv::Mat renderSystemText(const string& word, const wchar_t* face, int height, bool bold) {
+    // Ключевые слова хранятся в UTF-8, а GDI рисует строку UTF-16.
+    wstring text(MultiByteToWideChar(CP_UTF8, 0, word.data(), int(word.size()), nullptr, 0), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, word.data(), int(word.size()), text.data(), int(text.size()));
+
+    HDC dc = CreateCompatibleDC(nullptr);
+    HFONT font = CreateFontW(-height, 0, 0, 0, bold ? FW_BOLD : FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+        OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH, face);
+    HGDIOBJ oldFont = SelectObject(dc, font);
+    SIZE extent = {};
+    GetTextExtentPoint32W(dc, text.c_str(), int(text.size()), &extent);
+
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(info.bmiHeader);
+    info.bmiHeader.biWidth = extent.cx + 8;
+    // Отрицательная высота — строки сверху вниз, как в cv::Mat.
+    info.bmiHeader.biHeight = -(extent.cy + 8);
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+    void* bits = nullptr;
+    HBITMAP bitmap = CreateDIBSection(dc, &info, DIB_RGB_COLORS, &bits, nullptr, 0);
+
+    cv::Mat ink;
+    if (bitmap && extent.cx > 0) {
+        HGDIOBJ oldBitmap = SelectObject(dc, bitmap);
+        // DIB-секция создаётся обнулённой: белый текст на чёрном фоне сразу даёт чернила 255.
+        SetBkMode(dc, TRANSPARENT);
+        SetTextColor(dc, RGB(255, 255, 255));
+        TextOutW(dc, 4, 4, text.c_str(), int(text.size()));
+        GdiFlush();
+        cv::cvtColor(cv::Mat(extent.cy + 8, extent.cx + 8, CV_8UC4, bits), ink, cv::COLOR_BGRA2GRAY);
+        cv::threshold(ink, ink, 127, 255, cv::THRESH_BINARY);
+        SelectObject(dc, oldBitmap);
+    }
+    if (bitmap)
+        DeleteObject(bitmap);
+    SelectObject(dc, oldFont);
+    DeleteObject(font);
+    DeleteDC(dc);
+    return ink;
+}
+
+/**
+ * @brief Строит набор образцов ключевых слов.
+ *
+ * Английские слова рисуются встроенными шрифтами OpenCV, русские — шрифтами
+ * Windows (renderSystemText), в нескольких начертаниях и размерах. Образцы
+ * из каталога с вырезанными из сканов словами дополняют нарисованные:
+ * они точнее передают шрифт конкретных документов.
+ *
+ * @param dir Каталог с образцами или пустая строка.
+ * @return Набор образцов.
+ */
+vector<KeywordTemplate> buildKeywordTemplates(const string& dir) {
+    vector<KeywordTemplate> templates;
+    const int fonts[] = { cv::FONT_HERSHEY_SIMPLEX, cv::FONT_HERSHEY_DUPLEX,
+        cv::FONT_HERSHEY_COMPLEX, cv::FONT_HERSHEY_TRIPLEX };
+    for (const char* word : { "Table", "TABLE" }) {
+        for (int font : fonts) {
+            for (double scale : { 0.8, 1.5, 2.5 }) {
+                int thickness = scale < 1 ? 1 : 2;
+                int baseline = 0;
+                cv::Size size = cv::getTextSize(word, font, scale, thickness, &baseline);
+                cv::Mat canvas(size.height + baseline + 8, size.width + 8, CV_8UC1, cv::Scalar(0));
+                cv::putText(canvas, word, cv::Point(4, size.height + 4), font, scale, cv::Scalar(255), thickness, cv::LINE_AA);
+                addKeywordTemplate(canvas, templates);
+            }
+        }
+    }
+
+    for (const char* word : { "Таблица", "ТАБЛИЦА" }) {
+        for (const wchar_t* face : { L"Times New Roman", L"Arial", L"Courier New" }) {
+            for (int height : { 16, 32, 56 }) {
+                for (bool bold : { false, true }) {
+                    cv::Mat ink = renderSystemText(word, face, height, bold);
+                    if (!ink.empty())
+                        addKeywordTemplate(ink, templates);
+                }
+            }
+        }
+    }
+
+    if (!dir.empty()) {
+        error_code ec;
+        for (const auto& entry : filesystem::directory_iterator(dir, ec)) {
+            cv::Mat sample = cv::imread(entry.path().string(), cv::IMREAD_GRAYSCALE);
+            if (sample.empty())
+                continue;
+            cv::Mat ink;
+            cv::threshold(sample, ink, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+            addKeywordTemplate(ink, templates);
+        }
+        if (ec)
+            cerr << "Ошибка: не удалось прочитать каталог образцов " << dir << endl;
+    }
+    return templates;
+}
+
+/**
+ * @brief Находит строки, которые начинаются с похожего на ключевое слово слова.
+ *
+ * Буквы объединяются в слова горизонтальным расширением на треть медианной
+ * высоты символа, слова выделяются связными компонентами, и каждое слово
+ * подходящих размеров сравнивается с образцами по дескриптору профилей.
+ * Для найденных слов возвращается строка от слова до правого края страницы
+ * высотой в полторы высоты слова, чтобы не задеть соседние строки. Рамки,
+ * которые перекрываются больше чем на половину высоты (два совпадения на одной
+ * строке: «Таблица 3 / Table 3»), объединяются, и строка распознаётся один раз.
+ *
+ * @param img Изображение страницы.
+ * @param templates Образцы ключевых слов.
+ * @return Рамки строк-кандидатов в подписи сверху вниз.
+ */
+vector<cv::Rect> spotCaptionLines(const cv::Mat& img, const vector<KeywordTemplate>& templates) {
+    cv::Mat ink;
+    cv::threshold(toGray(img), ink, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+    cv::Mat labels, stats, centroids;
+    int count = cv::connectedComponentsWithStats(ink, labels, stats, centroids, 8, CV_32S);
+    vector<int> heights;
+    for (int label = 1; label < count; ++label) {
+        int h = stats.at<int>(label, cv::CC_STAT_HEIGHT);
+        if (h >= 6 && h <= img.rows / 20)
+            heights.push_back(h);
+    }
+    if (heights.empty())
+        return {};
+    nth_element(heights.begin(), heights.begin() + heights.size() / 2, heights.end());
+    const int glyphHeight = heights[heights.size() / 2];
+
+    cv::Mat words;
+    cv::dilate(ink, words, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(max(2, glyphHeight / 3), 1)));
+    count = cv::connectedComponentsWithStats(words, labels, stats, centroids, 8, CV_32S);
+
+    const double maxDistance = 0.25;
+    const cv::Rect page(0, 0, img.cols, img.rows);
+    vector<cv::Rect> lines;
+    for (int label = 1; label < count; ++label) {
+        cv::Rect word(stats.at<int>(label, cv::CC_STAT_LEFT), stats.at<int>(label, cv::CC_STAT_TOP),
+            stats.at<int>(label, cv::CC_STAT_WIDTH), stats.at<int>(label, cv::CC_STAT_HEIGHT));
+        if (word.height < glyphHeight * 0.6 || word.height > glyphHeight * 2.5)
+            continue;
+        const double aspect = double(word.width) / word.height;
+        if (aspect < 1.5 || aspect > 10)
+            continue;
+
+        cv::Mat descriptor;
+        for (const KeywordTemplate& keyword : templates) {
+            if (aspect < keyword.aspect * 0.65 || aspect > keyword.aspect * 1.35)
+                continue;
+            if (descriptor.empty())
+                descriptor = wordDescriptor(ink(word));
+            if (cv::norm(descriptor, keyword.descriptor, cv::NORM_L2) / sqrt(double(descriptor.cols)) > maxDistance)
+                continue;
+            cv::Rect line(word.x - word.height / 2, word.y - word.height / 4,
+                img.cols - word.x + word.height / 2, word.height * 3 / 2);
+            lines.push_back(line & page);
+            break;
+        }
+    }
+
+    sort(lines.begin(), lines.end(), [](const cv::Rect& a, const cv::Rect& b) {
+        return a.y < b.y;
+        });
+    vector<cv::Rect> merged;
+    for (const cv::Rect& line : lines) {
+        if (!merged.empty()) {
+            cv::Rect& last = merged.back();
+            const int overlap = min(last.br().y, line.br().y) - max(last.y, line.y);
+            if (overlap * 2 > min(last.height, line.height)) {
+                last |= line;
+                continue;
+            }
+        }
+        merged.push_back(line);
+    }
+    return merged;
+}
+
+/**
+ * @brief Проверяет, похож ли текст ячейки на число.
+ * @param text Текст ячейки.
+ * @return true, если в тексте есть цифры и нет ничего, кроме цифр и знаков числа.
+ */
+bool isNumericCell(string_view text) {
+    bool hasDigit = false;
+    for (unsigned char ch : text) {
+        if (isdigit(ch))
+            hasDigit = true;
+        else if (!strchr(".,-+% ", ch))
+            return false;
+    }
+    return hasDigit;
+}
+
+/**
+ * @brief Запускает вспомогательный поток на процессорах вызывающего потока.
+ *
+ * Windows даёт новому потоку маску процесса, а не создателя. Потоки полос
+ * и ячеек работают с экземплярами Tesseract, память которых выделена на
+ * узле NUMA закреплённого потока страниц (--pin), поэтому маска
+ * передаётся им явно.
+ *
+ * @param body Работа потока.
+ * @return Запущенный поток.
+ */
+thread startSiblingThread(function<void()> body) {
+    GROUP_AFFINITY affinity = {};
+    const bool known = GetThreadGroupAffinity(GetCurrentThread(), &affinity) != 0;
+    return thread([affinity, known, body = move(body)] {
+        if (known)
+            SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+        body();
+        });
+}
+
+/**
+ * @brief Распознаёт содержимое ячеек таблицы на пуле экземпляров Tesseract.
+ *
+ * Каждая ячейка распознаётся отдельно в режиме одной строки (или блока для
+ * высоких ячеек), что намного быстрее полного анализа разметки страницы.
+ * Сначала распознаётся первая строка данных; столбцы, где она числовая,
+ * затем распознаются со списком допустимых символов из цифр.
+ * Объединённые ячейки не распознаются: сетка строится по всем линиям таблицы.
+ *
+ * @param img Изображение страницы.
+ * @param table Таблица с найденными линиями сетки.
+ * @param engines Пул экземпляров Tesseract, по одному на поток.
+ * @param deadline Срок страницы или nullptr; после него оставшиеся ячейки не распознаются.
+ * @return Текст ячеек по строкам.
+ */
+vector<vector<string>> recognizeCells(const cv::Mat& img, const TableRegion& table,
+    vector<unique_ptr<tesseract::TessBaseAPI>>& engines, const PageDeadline* deadline = nullptr) {
+    if (table.rowLines.size() < 2 || table.colLines.size() < 2)
+        return {};
+
+    const size_t rowCount = table.rowLines.size() - 1;
+    const size_t colCount = table.colLines.size() - 1;
+    vector<vector<string>> cells(rowCount, vector<string>(colCount));
+    vector<char> numericColumn(colCount, 0);
+
+    cv::Mat ink;
+    cv::threshold(toGray(img(table.box)), ink, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+    auto cellRect = [&](size_t row, size_t col) {
+        // Отступ от линий, чтобы рамка ячейки не попала в распознавание.
+        const int inset = 3;
+        int x = table.colLines[col] + inset;
+        int y = table.rowLines[row] + inset;
+        return cv::Rect(x, y, table.colLines[col + 1] - inset - x, table.rowLines[row + 1] - inset - y);
+    };
+
+    auto recognizeJobs = [&](const vector<pair<size_t, size_t>>& jobs) {
+        atomic<size_t> nextJob{ 0 };
+        auto worker = [&](tesseract::TessBaseAPI* ocr) {
+            const tesseract::PageSegMode savedMode = ocr->GetPageSegMode();
+            for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+                auto [row, col] = jobs[i];
+                cv::Rect rect = cellRect(row, col);
+                if (rect.width <= 0 || rect.height <= 0)
+                    continue;
+                cv::Rect local(rect.x - table.box.x, rect.y - table.box.y, rect.width, rect.height);
+                if (cv::countNonZero(ink(local)) == 0)
+                    continue;
+
+                cv::Mat cell = img(rect);
+                ocr->SetPageSegMode(rect.height < img.rows / 25
+                    ? tesseract::PSM_SINGLE_LINE : tesseract::PSM_SINGLE_BLOCK);
+                ocr->SetVariable("tessedit_char_whitelist", numericColumn[col] ? "0123456789.,-+%" : "");
+                ocr->SetImage(cell.data, cell.cols, cell.rows, cell.channels(), cell.step);
+                if (recognizeBefore(ocr, deadline) != 0)
+                    continue;
+                unique_ptr<char[]> cellText(ocr->GetUTF8Text());
+                if (!cellText)
+                    continue;
+                string text(trim(cellText.get()));
+                replace(text.begin(), text.end(), '\n', ' ');
+                cells[row][col] = move(text);
+            }
+            ocr->SetVariable("tessedit_char_whitelist", "");
+            ocr->SetPageSegMode(savedMode);
+        };
+
+        vector<thread> threads;
+        for (size_t w = 1; w < engines.size() && w < jobs.size(); ++w)
+            threads.push_back(startSiblingThread([&worker, ocr = engines[w].get()] { worker(ocr); }));
+        worker(engines[0].get());
+        for (thread& t : threads)
+            t.join();
+    };
+
+    // Первая строка обычно заголовок, тип столбца определяется по следующей.
+    const size_t sampleRow = rowCount > 1 ? 1 : 0;
+    vector<pair<size_t, size_t>> sampleJobs, restJobs;
+    for (size_t row = 0; row < rowCount; ++row)
+        for (size_t col = 0; col < colCount; ++col)
+            (row == sampleRow ? sampleJobs : restJobs).emplace_back(row, col);
+
+    recognizeJobs(sampleJobs);
+    for (size_t col = 0; col < colCount; ++col)
+        numericColumn[col] = isNumericCell(cells[sampleRow][col]);
+    recognizeJobs(restJobs);
+
+    return cells;
+}
+
+/**
+ * @brief Экранирует строку для записи в поле CSV.
+ * @param field Значение поля.
+ * @return Поле, при необходимости заключённое в кавычки.
+ */
+string csvField(const string& field) {
+    if (field.find_first_of(",\"\n") == string::npos)
+        return field;
+    string quoted = "\"";
+    for (char ch : field) {
+        if (ch == '"')
+            quoted += '"';
+        quoted += ch;
+    }
+    return quoted + "\"";
+}
+
+/**
+ * @brief Экранирует строку для записи в JSON.
+ * @param value Значение строки.
+ * @return Строковый литерал JSON в кавычках.
+ */
+string jsonString(string_view value) {
+    string escaped = "\"";
+    for (unsigned char ch : value) {
+        switch (ch) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        default:
+            if (ch < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", ch);
+                escaped += code;
+            }
+            else {
+                escaped += char(ch);
+            }
+        }
+    }
+    return escaped + "\"";
+}
+
+/**
+ * @brief Сохраняет содержимое ячеек таблицы в CSV или JSON.
+ * @param path Путь к файлу.
+ * @param format "csv" или "json".
+ * @param caption Подпись таблицы или nullptr, если подпись не найдена.
+ * @param cells Текст ячеек по строкам.
+ * @return true, если файл записан.
+ */
+bool writeTableCells(const string& path, const string& format, const TableInfo* caption,
+    const vector<vector<string>>& cells) {
+    ofstream out(path, ios::binary);
+    if (!out)
+        return false;
+
+    if (format == "csv") {
+        for (const auto& row : cells) {
+            for (size_t col = 0; col < row.size(); ++col)
+                out << (col ? "," : "") << csvField(row[col]);
+            out << "\n";
+        }
+    }
+    else {
+        out << "{\"number\": " << (caption ? jsonString(caption->number) : "null")
+            << ", \"title\": " << (caption ? jsonString(trim(caption->title)) : "null")
+            << ", \"rows\": [";
+        for (size_t row = 0; row < cells.size(); ++row) {
+            out << (row ? ", " : "") << "[";
+            for (size_t col = 0; col < cells[row].size(); ++col)
+                out << (col ? ", " : "") << jsonString(cells[row][col]);
+            out << "]";
+        }
+        out << "]}\n";
+    }
+    return bool(out);
+}
+
+/**
+ * @brief Выбирает границы горизонтальных полос страницы.
+ *
+ * По горизонтальному профилю проекции находятся промежутки без чернил,
+ * и границы ставятся в их середину ближе всего к равномерному делению,
+ * поэтому ни одна строка текста не разрезается.
+ *
+ * @param img Изображение страницы.
+ * @param stripCount Желаемое число полос.
+ * @return Упорядоченные координаты границ, начиная с 0 и заканчивая высотой страницы.
+ */
+vector<int> findStripCuts(const cv::Mat& img, int stripCount) {
+    cv::Mat binary;
+    cv::threshold(toGray(img), binary, 0, 1, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+    cv::Mat profile;
+    cv::reduce(binary, profile, 1, cv::REDUCE_SUM, CV_32S);
+
+    // Строка считается пустой, если чернил в ней меньше 0.2% ширины (допуск на шум скана).
+    const int blankTolerance = max(1, img.cols / 500);
+    const int minGap = 3;
+    vector<int> gapCenters;
+    int gapStart = -1;
+    for (int y = 0; y <= profile.rows; ++y) {
+        bool blank = y < profile.rows && profile.at<int>(y, 0) <= blankTolerance;
+        if (blank && gapStart < 0)
+            gapStart = y;
+        else if (!blank && gapStart >= 0) {
+            if (gapStart > 0 && y < profile.rows && y - gapStart >= minGap)
+                gapCenters.push_back((gapStart + y) / 2);
+            gapStart = -1;
+        }
+    }
+
+    vector<int> cuts = { 0 };
+    const int minStripHeight = img.rows / (stripCount * 2);
+    for (int k = 1; k < stripCount; ++k) {
+        int target = img.rows * k / stripCount;
+        int best = -1;
+        for (int center : gapCenters) {
+            if (center - cuts.back() < minStripHeight || img.rows - center < minStripHeight)
+                continue;
+            if (best < 0 || abs(center - target) < abs(best - target))
+                best = center;
+        }
+        if (best > cuts.back())
+            cuts.push_back(best);
+    }
+    cuts.push_back(img.rows);
+    return cuts;
+}
+
+/**
+ * @brief Распознаёт страницу полосами параллельно на нескольких экземплярах Tesseract.
+ * @param img Изображение страницы.
+ * @param cuts Границы полос, полученные от findStripCuts.
+ * @param engines Инициализированные экземпляры Tesseract, по одному на поток.
+ * @param glyphChoices Использовать ли альтернативы символов (см. recognizeLines).
+ * @param deadline Срок страницы или nullptr.
+ * @return Строки полос в порядке чтения сверху вниз с рамками в координатах страницы.
+ */
+vector<OcrLine> recognizeInStrips(const cv::Mat& img, const vector<int>& cuts,
+    vector<unique_ptr<tesseract::TessBaseAPI>>& engines, bool glyphChoices = false, const PageDeadline* deadline = nullptr) {
+    const size_t stripCount = cuts.size() - 1;
+    vector<vector<OcrLine>> stripLines(stripCount);
+    atomic<size_t> nextStrip{ 0 };
+
+    auto worker = [&](tesseract::TessBaseAPI* ocr) {
+        for (size_t i = nextStrip++; i < stripCount; i = nextStrip++) {
+            cv::Mat strip = img(cv::Rect(0, cuts[i], img.cols, cuts[i + 1] - cuts[i]));
+            ocr->SetImage(strip.data, strip.cols, strip.rows, strip.channels(), strip.step);
+            stripLines[i] = recognizeLines(ocr, glyphChoices, deadline);
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t w = 1; w < engines.size() && w < stripCount; ++w)
+        threads.push_back(startSiblingThread([&worker, ocr = engines[w].get()] { worker(ocr); }));
+    worker(engines[0].get());
+    for (thread& t : threads)
+        t.join();
+
+    vector<OcrLine> lines;
+    for (size_t i = 0; i < stripCount; ++i)
+        appendLines(lines, move(stripLines[i]), cv::Point(0, cuts[i]));
+    return lines;
+}
+
+/**
+ * @brief Распознаёт множество фрагментов одним вызовом, склеив их в мозаику.
+ *
+ * Фрагменты в оттенках серого ставятся друг под другом через белые
+ * разделители, так что строки разных фрагментов не сливаются, и вся мозаика
+ * распознаётся одним Recognize. Каждая строка по центру своей рамки
+ * возвращается к фрагменту, из которого она взята. Если фрагментов слишком
+ * много для одного изображения Tesseract, мозаик будет несколько.
+ *
+ * @param ocr Экземпляр Tesseract.
+ * @param crops Распознаваемые фрагменты.
+ * @return Для каждого фрагмента — его строки с рамками в координатах фрагмента.
+ */
+vector<vector<OcrLine>> recognizeMosaic(tesseract::TessBaseAPI* ocr, const vector<cv::Mat>& crops) {
+    const int separator = 32;
+    // Tesseract отказывается от изображений со стороной больше 32767 пикселей.
+    const int maxHeight = 30000;
+
+    vector<vector<OcrLine>> lines(crops.size());
+    size_t first = 0;
+    while (first < crops.size()) {
+        size_t last = first;
+        int width = 1, height = 0;
+        while (last < crops.size() && (last == first || height + crops[last].rows + separator <= maxHeight)) {
+            width = max(width, crops[last].cols);
+            height += crops[last].rows + separator;
+            ++last;
+        }
+
+        cv::Mat mosaic(height, width, CV_8UC1, cv::Scalar(255));
+        vector<int> tops;
+        int y = 0;
+        for (size_t k = first; k < last; ++k) {
+            toGray(crops[k]).copyTo(mosaic(cv::Rect(0, y, crops[k].cols, crops[k].rows)));
+            tops.push_back(y);
+            y += crops[k].rows + separator;
+        }
+
+        ocr->SetImage(mosaic.data, mosaic.cols, mosaic.rows, mosaic.channels(), mosaic.step);
+        if (ocr->Recognize(nullptr) == 0) {
+            unique_ptr<tesseract::ResultIterator> it(ocr->GetIterator());
+            int block = -1;
+            if (it && !it->Empty(tesseract::RIL_TEXTLINE)) {
+                do {
+                    if (it->IsAtBeginningOf(tesseract::RIL_BLOCK))
+                        ++block;
+                    int left, top, right, bottom;
+                    it->BoundingBox(tesseract::RIL_TEXTLINE, &left, &top, &right, &bottom);
+                    unique_ptr<char[]> lineText(it->GetUTF8Text(tesseract::RIL_TEXTLINE));
+                    if (!lineText)
+                        continue;
+                    size_t k = upper_bound(tops.begin(), tops.end(), (top + bottom) / 2) - tops.begin() - 1;
+                    string text = lineText.get();
+                    replace(text.begin(), text.end(), '\n', ' ');
+                    lines[first + k].push_back({ move(text),
+                        cv::Rect(left, top - tops[k], right - left, bottom - top), max(block, 0) });
+                } while (it->Next(tesseract::RIL_TEXTLINE));
+            }
+        }
+        first = last;
+    }
+    return lines;
+}
+
+/**
+ * @struct PageCost
+ * @brief Признаки страницы и измеренное время её распознавания для модели стоимости.
+ *
+ * @var PageCost::pixels
+ * Пикселей в распознаваемом (возможно, уменьшенном) изображении.
+ * @var PageCost::colour
+ * Страница читалась цветной.
+ * @var PageCost::ink
+ * Статистика чернил (measureInk).
+ * @var PageCost::ocrMs
+ * Время распознавания в миллисекундах или 0, если оно не измерялось.
+ */
+struct PageCost {
+    double pixels = 0;
+    bool colour = true;
+    InkStats ink;
+    double ocrMs = 0;
+};
+
+/**
+ * @struct PageResult
+ * @brief Результат обработки одной страницы, ожидающий вывода.
+ *
+ * Подписи размещаются в собственной арене страницы, которая освобождается
+ * целиком вместе с результатом после вывода.
+ *
+ * @var PageResult::path
+ * Путь к изображению страницы.
+ * @var PageResult::skipReason
+ * Причина, по которой страница не распознавалась, или пустая строка.
+ * @var PageResult::tables
+ * Найденные подписи таблиц в порядке на странице.
+ * @var PageResult::references
+ * Ссылки на таблицы в тексте страницы (только при распознавании всей страницы).
+ * @var PageResult::contents
+ * Строки перечня таблиц на странице (только при распознавании всей страницы).
+ * @var PageResult::pageNumber
+ * Номер страницы по колонтитулу или 0, если он не распознавался.
+ * @var PageResult::fromJournal
+ * Результат взят из журнала прошлого запуска и повторно в журнал не пишется.
+ * @var PageResult::uncaptioned
+ * Рамки таблиц, для которых подпись не найдена.
+ * @var PageResult::notes
+ * Дополнительные сообщения для вывода вместе со страницей.
+ * @var PageResult::cost
+ * Признаки и время распознавания страницы.
+ */
+struct PageResult {
+    string path;
+    string skipReason;
+    unique_ptr<pmr::monotonic_buffer_resource> arena = make_unique<pmr::monotonic_buffer_resource>(16 * 1024);
+    pmr::vector<TableInfo> tables{ arena.get() };
+    pmr::vector<TableReference> references{ arena.get() };
+    pmr::vector<ContentsEntry> contents{ arena.get() };
+    int pageNumber = 0;
+    bool fromJournal = false;
+    vector<cv::Rect> uncaptioned;
+    vector<string> notes;
+    PageCost cost;
+};
+
+/**
+ * @struct PendingPage
+ * @brief Страница, ожидающая распознавания в пакете мозаики или вывода.
+ *
+ * @var PendingPage::error
+ * Сообщение об ошибке, если страница не обработана (не загрузилась,
+ * процесс распознавания упал), или пустая строка.
+ * @var PendingPage::reduction
+ * Во сколько раз изображение уменьшено при чтении, чтобы уложиться в бюджет памяти.
+ */
+struct PendingPage {
+    PageResult result;
+    cv::Mat img;
+    vector<TableRegion> regions;
+    string error;
+    int reduction = 1;
+};
+
+/**
+ * @brief Переводит рамки страницы, прочитанной уменьшенной, в масштаб исходного изображения.
+ * @param page Распознанная страница.
+ */
+void restorePageScale(PendingPage& page) {
+    const int r = page.reduction;
+    if (r == 1)
+        return;
+    for (cv::Rect& box : page.result.uncaptioned)
+        box = cv::Rect(box.x * r, box.y * r, box.width * r, box.height * r);
+    page.reduction = 1;
+}
+
+/**
+ * @brief Задаёт Tesseract разрешение страницы из заголовка файла.
+ *
+ * Изображение передаётся Tesseract без сведений о разрешении, и без
+ * user_defined_dpi он оценивает его по высоте строк, ошибаясь на мелком
+ * тексте. Значения вне допустимого Tesseract диапазона сбрасываются.
+ *
+ * @param engines Экземпляры Tesseract вызывающего потока.
+ * @param dpi Разрешение или 0, если неизвестно.
+ */
+void setPageResolution(vector<unique_ptr<tesseract::TessBaseAPI>>& engines, int dpi) {
+    const string value = dpi >= 70 && dpi <= 2400 ? to_string(dpi) : "0";
+    for (auto& engine : engines)
+        engine->SetVariable("user_defined_dpi", value.c_str());
+}
+
+/**
+ * @brief Читает изображение страницы по её заголовку (planPageRead).
+ * @param options Параметры запуска.
+ * @param path Путь к изображению.
+ * @param minReduction Наименьшее уменьшение при чтении.
+ * @param page Страница; заполняются путь, уменьшение и сообщения.
+ * @param engines Экземпляры Tesseract, которым задаётся разрешение, или nullptr.
+ * @return Изображение или пустая матрица, если оно не загрузилось.
+ */
+cv::Mat loadPage(const Options& options, const string& path, int minReduction, PendingPage& page,
+    vector<unique_ptr<tesseract::TessBaseAPI>>* engines) {
+    const PageRead plan = planPageRead(options, path, minReduction);
+    page.result.path = path;
+    page.reduction = plan.reduction;
+    if (plan.overBudget)
+        page.result.notes.push_back("страница не укладывается в бюджет памяти и распознана в масштабе 1/"
+            + to_string(plan.reduction));
+    if (plan.pages > 1)
+        page.result.notes.push_back("многостраничный TIFF: распознана только первая из " + to_string(plan.pages)
+            + " страниц");
+    if (engines)
+        setPageResolution(*engines, plan.dpi);
+    return readPage(path, plan);
+}
+
+/**
+ * @brief Экранирует поле записи страницы: табуляции, переводы строк и обратную косую черту.
+ */
+string escapeField(string_view field) {
+    string escaped;
+    for (char c : field) {
+        switch (c) {
+        case '\\': escaped += "\\\\"; break;
+        case '\t': escaped += "\\t"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        default: escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Разбирает поле записи страницы, экранированное escapeField.
+ */
+string unescapeField(string_view field) {
+    string text;
+    for (size_t i = 0; i < field.size(); ++i) {
+        if (field[i] != '\\' || i + 1 == field.size()) {
+            text += field[i];
+            continue;
+        }
+        const char c = field[++i];
+        text += c == 't' ? '\t' : c == 'n' ? '\n' : c == 'r' ? '\r' : c;
+    }
+    return text;
+}
+
+/**
+ * @brief Записывает результат страницы одной строкой для передачи между процессами.
+ *
+ * Поля разделены табуляцией: путь, причина пропуска, номер страницы, затем
+ * списки сообщений, подписей, ссылок, строк перечня и таблиц без подписи,
+ * каждый с числом элементов впереди, и в конце признаки PageCost.
+ *
+ * @param page Результат страницы.
+ * @return Строка без завершающего перевода строки.
+ */
+string encodePage(const PageResult& page) {
+    ostringstream record;
+    auto field = [&](const auto& value) { record << '\t' << value; };
+    auto text = [&](string_view value) { field(escapeField(value)); };
+
+    record << escapeField(page.path);
+    text(page.skipReason);
+    field(page.pageNumber);
+    field(page.notes.size());
+    for (const string& note : page.notes)
+        text(note);
+    field(page.tables.size());
+    for (const TableInfo& table : page.tables) {
+        text(table.type);
+        field(int(table.role));
+        text(table.number);
+        text(table.title);
+        field(table.line);
+    }
+    field(page.references.size());
+    for (const TableReference& reference : page.references) {
+        text(reference.number);
+        field(reference.line);
+    }
+    field(page.contents.size());
+    for (const ContentsEntry& entry : page.contents) {
+        text(entry.number);
+        text(entry.title);
+        field(entry.page);
+    }
+    field(page.uncaptioned.size());
+    for (const cv::Rect& box : page.uncaptioned) {
+        field(box.x);
+        field(box.y);
+        field(box.width);
+        field(box.height);
+    }
+    field(page.cost.pixels);
+    field(int(page.cost.colour));
+    field(page.cost.ink.inkRatio);
+    field(page.cost.ink.glyphComponents);
+    field(page.cost.ocrMs);
+    return record.str();
+}
+
+/**
+ * @brief Восстанавливает результат страницы из строки encodePage.
+ *
+ * Тип подписи сопоставляется с типами сканера, чтобы TableInfo::type
+ * ссылался на его строки; подписи неизвестных сканеру типов отбрасываются.
+ *
+ * @param record Строка записи.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param page Заполняемый результат страницы.
+ * @return false, если запись повреждена.
+ */
+bool decodePage(string_view record, const CaptionScanner& scanner, PageResult& page) {
+    vector<string> fields;
+    for (size_t start = 0;;) {
+        const size_t tab = record.find('\t', start);
+        fields.push_back(unescapeField(record.substr(start, tab - start)));
+        if (tab == string_view::npos)
+            break;
+        start = tab + 1;
+    }
+
+    size_t next = 0;
+    // За концом записи поля пустые, а next уходит за fields.size(), что и отмечает повреждение.
+    auto take = [&] { return next < fields.size() ? fields[next++] : (++next, string()); };
+    auto count = [&] { return size_t(strtoull(take().c_str(), nullptr, 10)); };
+
+    page.path = take();
+    page.skipReason = take();
+    page.pageNumber = atoi(take().c_str());
+    for (size_t n = count(); n > 0 && next <= fields.size(); --n)
+        page.notes.push_back(take());
+    for (size_t n = count(); n > 0 && next <= fields.size(); --n) {
+        const string& type = take();
+        auto known = find(scanner.types.begin(), scanner.types.end(), type);
+        TableInfo table(page.tables.get_allocator());
+        table.role = CaptionRole(atoi(take().c_str()));
+        table.number.assign(take());
+        table.title.assign(take());
+        table.line = size_t(strtoull(take().c_str(), nullptr, 10));
+        if (known == scanner.types.end())
+            continue;
+        table.type = *known;
+        page.tables.push_back(move(table));
+    }
+    for (size_t n = count(); n > 0 && next <= fields.size(); --n) {
+        TableReference& reference = page.references.emplace_back();
+        reference.number.assign(take());
+        reference.line = size_t(strtoull(take().c_str(), nullptr, 10));
+    }
+    for (size_t n = count(); n > 0 && next <= fields.size(); --n) {
+        ContentsEntry& entry = page.contents.emplace_back();
+        entry.number.assign(take());
+        entry.title.assign(take());
+        entry.page = atoi(take().c_str());
+    }
+    for (size_t n = count(); n > 0 && next <= fields.size(); --n) {
+        cv::Rect box;
+        box.x = atoi(take().c_str());
+        box.y = atoi(take().c_str());
+        box.width = atoi(take().c_str());
+        box.height = atoi(take().c_str());
+        page.uncaptioned.push_back(box);
+    }
+    page.cost.pixels = atof(take().c_str());
+    page.cost.colour = atoi(take().c_str()) != 0;
+    page.cost.ink.inkRatio = atof(take().c_str());
+    page.cost.ink.glyphComponents = atoi(take().c_str());
+    page.cost.ocrMs = atof(take().c_str());
+    return next == fields.size();
+}
+
+/**
+ * @struct Journal
+ * @brief Журнал обработанных страниц: дописываемый файл записей encodePage.
+ *
+ * Первая строка — заголовок с параметрами запуска: продолжать можно только
+ * запуск с теми же параметрами. Записи сбрасываются на диск (_commit)
+ * пачками, не чаще раза в syncInterval и не реже чем через syncRecords
+ * записей, поэтому журнал не замедляет обработку, а при сбое теряется
+ * не больше последней пачки.
+ *
+ * @var Journal::completed
+ * Записи прошлых запусков по пути к изображению.
+ */
+struct Journal {
+    static constexpr size_t syncRecords = 64;
+    static constexpr chrono::seconds syncInterval{ 2 };
+
+    FILE* file = nullptr;
+    unordered_map<string, string> completed;
+    size_t unsynced = 0;
+    chrono::steady_clock::time_point lastSync = chrono::steady_clock::now();
+
+    ~Journal() {
+        if (file) {
+            fflush(file);
+            _commit(_fileno(file));
+            fclose(file);
+        }
+    }
+};
+
+/**
+ * @brief Открывает журнал, читая записи прошлых запусков.
+ *
+ * Последняя запись могла оборваться при сбое: она не разбирается и
+ * считается необработанной, а следующая запись начинается с новой строки.
+ *
+ * @param path Путь к журналу.
+ * @param header Заголовок с параметрами запуска.
+ * @param journal Открытый журнал.
+ * @return false, если журнал создан с другими параметрами или не открывается.
+ */
+bool openJournal(const string& path, const string& header, Journal& journal) {
+    bool endsWithNewline = true;
+    {
+        ifstream in(path, ios::binary);
+        string line;
+        if (in && getline(in, line)) {
+            if (line != header) {
+                cerr << "Ошибка: журнал " << path << " создан с другими параметрами." << endl;
+                return false;
+            }
+            while (getline(in, line)) {
+                endsWithNewline = !in.eof();
+                const string pagePath = unescapeField(string_view(line).substr(0, line.find('\t')));
+                if (endsWithNewline)
+                    journal.completed[pagePath] = move(line);
+            }
+        }
+        else {
+            endsWithNewline = false;
+        }
+    }
+
+    journal.file = fopen(path.c_str(), "ab");
+    if (!journal.file) {
+        cerr << "Ошибка: не удалось открыть журнал " << path << endl;
+        return false;
+    }
+    if (journal.completed.empty() && ftell(journal.file) == 0)
+        fprintf(journal.file, "%s\n", header.c_str());
+    else if (!endsWithNewline)
+        fputc('\n', journal.file);
+    return true;
+}
+
+/**
+ * @brief Дописывает результат страницы в журнал.
+ * @param journal Журнал.
+ * @param page Результат страницы.
+ */
+void journalPage(Journal& journal, const PageResult& page) {
+    const string record = encodePage(page);
+    fwrite(record.data(), 1, record.size(), journal.file);
+    fputc('\n', journal.file);
+
+    const auto now = chrono::steady_clock::now();
+    if (++journal.unsynced >= Journal::syncRecords || now - journal.lastSync >= Journal::syncInterval) {
+        fflush(journal.file);
+        _commit(_fileno(journal.file));
+        journal.unsynced = 0;
+        journal.lastSync = now;
+    }
+}
+
+/**
+ * @brief Восстанавливает страницу, уже обработанную в прошлом запуске.
+ * @param journal Журнал или nullptr.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param path Путь к изображению.
+ * @return Страница из журнала или nullptr, если её там нет.
+ */
+unique_ptr<PendingPage> resumePage(const Journal* journal, const CaptionScanner& scanner, const string& path) {
+    if (!journal)
+        return nullptr;
+    auto it = journal->completed.find(path);
+    if (it == journal->completed.end())
+        return nullptr;
+    auto page = make_unique<PendingPage>();
+    if (!decodePage(it->second, scanner, page->result))
+        return nullptr;
+    page->result.fromJournal = true;
+    return page;
+}
+
+/**
+ * @brief Дописывает признаки и время распознавания страницы в журнал стоимости.
+ *
+ * Строка: путь, мегапиксели, мегабайты файла, цветность, доля чернил,
+ * компоненты размером с символ, найдено таблиц, время в миллисекундах.
+ * Страницы без измеренного времени (пропущенные, из мозаики) не пишутся.
+ *
+ * @param log Журнал стоимости.
+ * @param page Результат страницы.
+ */
+void logPageCost(FILE* log, const PageResult& page) {
+    if (page.cost.ocrMs <= 0)
+        return;
+    error_code error;
+    const uintmax_t bytes = filesystem::file_size(page.path, error);
+    fprintf(log, "%s\t%.4f\t%.4f\t%d\t%.5f\t%d\t%zu\t%.1f\n", escapeField(page.path).c_str(),
+        page.cost.pixels / 1e6, error ? 0.0 : bytes / 1048576.0, int(page.cost.colour),
+        page.cost.ink.inkRatio, page.cost.ink.glyphComponents,
+        page.tables.size() + page.uncaptioned.size(), page.cost.ocrMs);
+    fflush(log);
+}
+
+/**
+ * @struct CostModel
+ * @brief Линейная модель времени распознавания страницы.
+ *
+ * Прогноз нужен до декодирования страницы, поэтому признаки модели берутся
+ * из заголовка файла: свободный член, мегапиксели после уменьшения при
+ * чтении, мегабайты файла и цветность. Размер сжатого файла растёт с долей
+ * чернил и числом символов, поэтому заменяет их в прогнозе; сами они
+ * остаются в журнале стоимости для оценки мощностей.
+ */
+struct CostModel {
+    static constexpr int featureCount = 4;
+    array<double, featureCount> weights{};
+
+    /** @brief Прогноз времени распознавания в миллисекундах (не меньше 1). */
+    double predict(const array<double, featureCount>& features) const {
+        double ms = 0;
+        for (int k = 0; k < featureCount; ++k)
+            ms += weights[k] * features[k];
+        return max(1.0, ms);
+    }
+};
+
+/**
+ * @brief Признаки модели стоимости для страницы, ещё не прочитанной с диска.
+ * @param options Параметры запуска (уменьшение при чтении).
+ * @param path Путь к изображению.
+ * @return Признаки в порядке CostModel.
+ */
+array<double, CostModel::featureCount> pageCostFeatures(const Options& options, const string& path) {
+    const PageRead plan = planPageRead(options, path, 1);
+    error_code error;
+    const uintmax_t bytes = filesystem::file_size(path, error);
+    return { 1.0, plan.size.area() / 1e6, error ? 0.0 : bytes / 1048576.0, plan.grayscale ? 0.0 : 1.0 };
+}
+
+/**
+ * @brief Читает модель стоимости, сохранённую fitCostModel.
+ * @param path Путь к файлу модели.
+ * @param model Модель.
+ * @return false, если файл не читается или не является моделью.
+ */
+bool loadCostModel(const string& path, CostModel& model) {
+    ifstream in(path);
+    string header;
+    if (!getline(in, header) || header != "GetTable cost model 1")
+        return false;
+    for (double& weight : model.weights)
+        if (!(in >> weight))
+            return false;
+    return true;
+}
+
+/**
+ * @brief Строит модель стоимости по журналу --cost-log и сохраняет её.
+ *
+ * Веса подбираются методом наименьших квадратов (cv::solve, SVD), что
+ * устойчиво и при почти совпадающих признаках, например когда все
+ * страницы пакета одного формата.
+ *
+ * @param logPath Журнал стоимости.
+ * @param modelPath Файл создаваемой модели.
+ * @return false, если журнал не читается, в нём мало страниц или модель не записана.
+ */
+bool fitCostModel(const string& logPath, const string& modelPath) {
+    ifstream in(logPath);
+    if (!in) {
+        cerr << "Ошибка: не удалось открыть журнал стоимости " << logPath << endl;
+        return false;
+    }
+
+    vector<array<double, CostModel::featureCount>> features;
+    vector<double> times;
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line.substr(min(line.size(), line.find('\t'))));
+        double megapixels, megabytes, inkRatio, ms;
+        int colour, components;
+        size_t tables;
+        if (!(fields >> megapixels >> megabytes >> colour >> inkRatio >> components >> tables >> ms))
+            continue;
+        features.push_back({ 1.0, megapixels, megabytes, double(colour) });
+        times.push_back(ms);
+    }
+    const int rows = int(times.size());
+    if (rows < CostModel::featureCount * 2) {
+        cerr << "Ошибка: в журнале стоимости слишком мало страниц: " << rows << endl;
+        return false;
+    }
+
+    cv::Mat weights;
+    cv::solve(cv::Mat(rows, CostModel::featureCount, CV_64F, features.data()), cv::Mat(rows, 1, CV_64F, times.data()),
+        weights, cv::DECOMP_SVD);
+    CostModel model;
+    for (int k = 0; k < CostModel::featureCount; ++k)
+        model.weights[k] = weights.at<double>(k);
+    double meanError = 0;
+    for (int i = 0; i < rows; ++i)
+        meanError += abs(model.predict(features[i]) - times[i]) / rows;
+
+    ofstream out(modelPath);
+    out << "GetTable cost model 1" << endl;
+    for (int k = 0; k < CostModel::featureCount; ++k)
+        out << model.weights[k] << (k + 1 < CostModel::featureCount ? ' ' : '\n');
+    if (!out) {
+        cerr << "Ошибка: не удалось записать модель " << modelPath << endl;
+        return false;
+    }
+    cout << "Модель стоимости построена по " << rows << " страницам, средняя ошибка "
+        << lround(meanError) << " мс" << endl;
+    return true;
+}
+
+/**
+ * @struct Progress
+ * @brief Прогноз оставшегося времени пакета по модели стоимости.
+ *
+ * Прогнозы модели переводятся во время пакета по уже обработанным
+ * страницам: отношение прошедшего времени к сумме их прогнозов учитывает
+ * и число потоков, и систематическую ошибку модели на этой машине.
+ *
+ * @var Progress::predicted
+ * Прогноз времени распознавания по пути к изображению, мс.
+ * @var Progress::remaining
+ * Сумма прогнозов ещё не выведенных страниц.
+ * @var Progress::done
+ * Сумма прогнозов страниц, распознанных в этом запуске.
+ */
+struct Progress {
+    static constexpr chrono::seconds reportInterval{ 10 };
+
+    unordered_map<string, double> predicted;
+    double remaining = 0;
+    double done = 0;
+    size_t emitted = 0;
+    size_t total = 0;
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    chrono::steady_clock::time_point lastReport = started;
+};
+
+/**
+ * @brief Учитывает выведенную страницу и не чаще раза в reportInterval сообщает оставшееся время.
+ * @param progress Прогноз пакета.
+ * @param page Выведенная страница.
+ */
+void reportProgress(Progress& progress, const PageResult& page) {
+    auto it = progress.predicted.find(page.path);
+    const double predicted = it != progress.predicted.end() ? it->second : 0;
+    progress.remaining -= predicted;
+    ++progress.emitted;
+    // Страницы из журнала не распознавались и не говорят о скорости.
+    if (!page.fromJournal)
+        progress.done += predicted;
+
+    const auto now = chrono::steady_clock::now();
+    if (now - progress.lastReport < Progress::reportInterval || progress.done <= 0 || progress.emitted == progress.total)
+        return;
+    progress.lastReport = now;
+    const double elapsed = chrono::duration<double>(now - progress.started).count();
+    const long long left = llround(max(0.0, progress.remaining) * elapsed / progress.done);
+    cerr << "Обработано страниц: " << progress.emitted << " из " << progress.total << ", осталось около "
+        << left / 60 << " мин " << left % 60 << " с" << endl;
+}
+
+/**
+ * @brief Создаёт недостающие экземпляры Tesseract в пуле.
+ * @param options Параметры запуска.
+ * @param engines Пул экземпляров.
+ * @param count Требуемый размер пула.
+ * @return false, если Tesseract не удалось инициализировать.
+ */
+bool ensureEngines(const Options& options, vector<unique_ptr<tesseract::TessBaseAPI>>& engines, size_t count) {
+    while (engines.size() < count) {
+        auto ocr = createOcrEngine(options);
+        if (!ocr) {
+            cerr << "Не удалось инициализировать tesseract." << endl;
+            return false;
+        }
+        engines.push_back(move(ocr));
+    }
+    return true;
+}
+
+/**
+ * @brief Находит подписи найденных таблиц и при необходимости выгружает их ячейки.
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param img Изображение страницы.
+ * @param regions Таблицы страницы.
+ * @param engines Пул экземпляров Tesseract.
+ * @param bandLines Уже распознанные строки полос (над и под каждой таблицей подряд)
+ * или nullptr, чтобы распознать полосы здесь.
+ * @param page Заполняемый результат страницы.
+ * @param deadline Срок страницы или nullptr.
+ */
+void processTablePage(const Options& options, const CaptionScanner& scanner, const cv::Mat& img, const vector<TableRegion>& regions,
+    vector<unique_ptr<tesseract::TessBaseAPI>>& engines, const vector<vector<OcrLine>>* bandLines, PageResult& page,
+    const PageDeadline* deadline = nullptr) {
+    if (!bandLines && !regions.empty())
+        engines[0]->SetImage(img.data, img.cols, img.rows, img.channels(), img.step);
+
+    auto bandCaptions = [&](size_t t, bool above) {
+        vector<OcrLine> lines = bandLines ? (*bandLines)[2 * t + (above ? 0 : 1)]
+            : recognizeRegion(engines[0].get(), above ? regions[t].captionAbove : regions[t].captionBelow,
+                options.glyphChoices, deadline);
+        return extractTableInfo(joinLines(lines), page.arena.get(), scanner, &lines);
+    };
+
+    auto isTableCaption = [](const TableInfo& caption) {
+        return caption.type == tableCaptionType;
+    };
+
+    // Индекс подписи каждой найденной таблицы в page.tables или -1.
+    vector<int> captionIndex;
+    for (size_t t = 0; t < regions.size(); ++t) {
+        pmr::vector<TableInfo> found = bandCaptions(t, true);
+        // Ближайшая к таблице подпись — последняя в полосе над ней.
+        auto above = find_if(found.rbegin(), found.rend(), isTableCaption);
+        if (above != found.rend()) {
+            captionIndex.push_back(int(page.tables.size()));
+            page.tables.push_back(move(*above));
+            continue;
+        }
+        found = bandCaptions(t, false);
+        auto below = find_if(found.begin(), found.end(), isTableCaption);
+        if (below != found.end()) {
+            captionIndex.push_back(int(page.tables.size()));
+            page.tables.push_back(move(*below));
+        }
+        else {
+            captionIndex.push_back(-1);
+            page.uncaptioned.push_back(regions[t].box);
+        }
+    }
+
+    if (options.cellFormat.empty())
+        return;
+    const string stem = page.path.substr(0, page.path.find_last_of('.'));
+    for (size_t t = 0; t < regions.size(); ++t) {
+        vector<vector<string>> cells = recognizeCells(img, regions[t], engines, deadline);
+        if (cells.empty())
+            continue;
+        const TableInfo* caption = captionIndex[t] >= 0 ? &page.tables[captionIndex[t]] : nullptr;
+        const string cellPath = stem + "_table" + to_string(t + 1) + "." + options.cellFormat;
+        if (writeTableCells(cellPath, options.cellFormat, caption, cells))
+            page.notes.push_back("Содержимое таблицы сохранено: " + cellPath);
+        else
+            cerr << "Ошибка: не удалось записать " << cellPath << endl;
+    }
+}
+
+/**
+ * @brief Распознаёт только строки, найденные поиском ключевого слова по форме.
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param img Изображение страницы.
+ * @param templates Образцы ключевых слов.
+ * @param engines Пул экземпляров Tesseract.
+ * @param page Заполняемый результат страницы.
+ * @param deadline Срок страницы или nullptr.
+ */
+void processSpottedPage(const Options& options, const CaptionScanner& scanner, const cv::Mat& img, const vector<KeywordTemplate>& templates,
+    vector<unique_ptr<tesseract::TessBaseAPI>>& engines, PageResult& page, const PageDeadline* deadline = nullptr) {
+    vector<cv::Rect> lines = spotCaptionLines(img, templates);
+    if (lines.empty())
+        return;
+
+    engines[0]->SetImage(img.data, img.cols, img.rows, img.channels(), img.step);
+    vector<OcrLine> ocrLines;
+    for (const cv::Rect& line : lines)
+        appendLines(ocrLines, recognizeRegion(engines[0].get(), line, options.glyphChoices, deadline));
+
+    page.tables = extractTableInfo(joinLines(ocrLines), page.arena.get(), scanner, &ocrLines);
+}
+
+/**
+ * @brief Распознаёт страницу целиком (или полосами) и извлекает подписи таблиц.
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param img Изображение страницы.
+ * @param engines Пул экземпляров Tesseract.
+ * @param page Заполняемый результат страницы.
+ * @param deadline Срок страницы или nullptr.
+ */
+void processTextPage(const Options& options, const CaptionScanner& scanner, const cv::Mat& img,
+    vector<unique_ptr<tesseract::TessBaseAPI>>& engines, PageResult& page, const PageDeadline* deadline = nullptr) {
+    vector<int> cuts = { 0, img.rows };
+    if (options.stripWorkers > 1)
+        cuts = findStripCuts(img, options.stripWorkers);
+
+    vector<OcrLine> lines = recognizeInStrips(img, cuts, engines, options.glyphChoices, deadline);
+
+    const string text = joinLines(lines);
+
+    //cout << text << endl;
+
+    page.tables = extractTableInfo(text, page.arena.get(), scanner, &lines);
+    page.references = extractTableReferences(text, page.arena.get(), page.tables);
+    page.contents = extractContentsEntries(text, page.tables, page.arena.get());
+}
+
+/**
+ * @brief Добавляет подписи таблиц и ссылки на них со страницы в индекс документа.
+ *
+ * Подписи и ссылки страницы обходятся вместе в порядке строк, так что ссылка
+ * выше подписи на той же странице тоже считается опередившей таблицу.
+ *
+ * @param page Результат страницы.
+ * @param index Индекс документа.
+ */
+void indexReferences(const PageResult& page, ReferenceIndex& index) {
+    const size_t pageIndex = index.pages.size();
+    index.pages.push_back(page.path);
+
+    auto entry = [&](string_view number) -> ReferenceIndex::Entry& {
+        while (!number.empty() && number.back() == '.')
+            number.remove_suffix(1);
+        auto [it, inserted] = index.entries.try_emplace(string(number));
+        if (inserted)
+            index.order.push_back(it->first);
+        return it->second;
+    };
+
+    size_t r = 0;
+    for (size_t c = 0; c <= page.tables.size(); ++c) {
+        const size_t captionLine = c < page.tables.size() ? page.tables[c].line : SIZE_MAX;
+        for (; r < page.references.size() && page.references[r].line < captionLine; ++r)
+            entry(page.references[r].number).references.push_back({ pageIndex, page.references[r].line });
+
+        if (c == page.tables.size() || page.tables[c].type != tableCaptionType)
+            continue;
+        ReferenceIndex::Entry& table = entry(page.tables[c].number);
+        if (!table.captioned) {
+            table.captioned = true;
+            table.caption = { pageIndex, captionLine };
+            table.referencesBeforeCaption = table.references.size();
+        }
+    }
+}
+
+/**
+ * @brief Выводит ссылки на отсутствующие таблицы и ссылки, опередившие таблицу.
+ * @param index Индекс документа.
+ */
+void reportReferences(const ReferenceIndex& index) {
+    auto position = [&](const ReferenceIndex::Position& at) {
+        return index.pages[at.page] + ", строка " + to_string(at.line + 1);
+    };
+
+    bool header = false;
+    for (const string& number : index.order) {
+        const ReferenceIndex::Entry& table = index.entries.at(number);
+        if (table.captioned)
+            continue;
+        if (!header)
+            cout << "\nСсылки на отсутствующие таблицы:" << endl;
+        header = true;
+        for (const ReferenceIndex::Position& at : table.references)
+            cout << "Таблица " << number << ": " << position(at) << endl;
+    }
+
+    header = false;
+    for (const string& number : index.order) {
+        const ReferenceIndex::Entry& table = index.entries.at(number);
+        if (!table.captioned || table.referencesBeforeCaption == 0)
+            continue;
+        if (!header)
+            cout << "\nСсылки до первого появления таблицы:" << endl;
+        header = true;
+        for (size_t i = 0; i < table.referencesBeforeCaption; ++i) {
+            cout << "Таблица " << number << " (подпись: " << position(table.caption) << "): "
+                << position(table.references[i]) << endl;
+        }
+    }
+}
+
+/**
+ * @brief Добавляет строки перечня таблиц и первые подписи таблиц страницы в перечень документа.
+ * @param page Результат страницы.
+ * @param contents Перечень документа.
+ */
+void indexContents(const PageResult& page, ContentsIndex& contents) {
+    contents.listed.insert(contents.listed.end(), page.contents.begin(), page.contents.end());
+    for (const TableInfo& table : page.tables) {
+        if (table.type != tableCaptionType || table.role != CaptionRole::Start)
+            continue;
+        string_view number = table.number;
+        while (!number.empty() && number.back() == '.')
+            number.remove_suffix(1);
+        contents.found.try_emplace(string(number), ContentsIndex::Found{ string(trim(table.title)), page.pageNumber, page.path });
+    }
+}
+
+/**
+ * @brief Сверяет перечень таблиц с найденными подписями и выводит расхождения.
+ *
+ * Для каждой строки перечня проверяется, что подпись с таким номером есть,
+ * что номер страницы по колонтитулу совпадает с указанным в перечне и что
+ * названия совпадают с точностью до ошибок распознавания (titleSimilarity).
+ *
+ * @param contents Перечень документа.
+ */
+void reportContents(const ContentsIndex& contents) {
+    if (contents.listed.empty())
+        return;
+
+    // Названия с меньшим сходством считаются разными.
+    const double minSimilarity = 0.75;
+
+    cout << "\nСверка с перечнем таблиц:" << endl;
+    size_t mismatches = 0;
+    for (const ContentsEntry& entry : contents.listed) {
+        string_view number = entry.number;
+        while (!number.empty() && number.back() == '.')
+            number.remove_suffix(1);
+        auto it = contents.found.find(string(number));
+        if (it == contents.found.end()) {
+            cout << "Таблица " << number << " (стр. " << entry.page << " по перечню) не найдена" << endl;
+            ++mismatches;
+            continue;
+        }
+        const ContentsIndex::Found& found = it->second;
+        if (found.page == 0) {
+            cout << "Таблица " << number << ": номер страницы не распознан (" << found.path << ")" << endl;
+            ++mismatches;
+        }
+        else if (found.page != entry.page) {
+            cout << "Таблица " << number << ": по перечню стр. " << entry.page
+                << ", найдена на стр. " << found.page << " (" << found.path << ")" << endl;
+            ++mismatches;
+        }
+        if (!entry.title.empty() && titleSimilarity(entry.title, found.title) < minSimilarity) {
+            cout << "Таблица " << number << ": название в перечне «" << entry.title
+                << "», в подписи «" << found.title << "»" << endl;
+            ++mismatches;
+        }
+    }
+    if (mismatches == 0)
+        cout << "Все " << contents.listed.size() << " таблиц перечня найдены на указанных страницах" << endl;
+}
+
+/**
+ * @brief Выводит результат страницы.
+ *
+ * Нумерация проверяется относительно всех ранее выведенных страниц документа,
+ * подписи, ссылки на таблицы и строки перечня добавляются в индексы документа.
+ * Новые страницы записываются в журнал: вывод идёт в порядке документа,
+ * поэтому журнал пишет один поток.
+ *
+ * @param page Результат страницы.
+ * @param withHeader Печатать ли заголовок с путём к странице.
+ * @param document Состояние проверок документа.
+ */
+void emitPage(const PageResult& page, bool withHeader, DocumentState& document) {
+    if (document.journal && !page.fromJournal)
+        journalPage(*document.journal, page);
+    if (document.costLog && !page.fromJournal)
+        logPageCost(document.costLog, page);
+    if (document.progress)
+        reportProgress(*document.progress, page);
+
+    if (withHeader)
+        cout << "==== Страница: " << page.path << " ====" << endl;
+
+    if (!page.skipReason.empty()) {
+        cout << "Страница пропущена: " << page.skipReason << endl;
+        return;
+    }
+
+    if (page.pageNumber > 0)
+        cout << "Номер страницы: " << page.pageNumber << endl;
+    if (!page.contents.empty())
+        cout << "Строк перечня таблиц: " << page.contents.size() << endl;
+
+    indexReferences(page, document.references);
+    indexContents(page, document.contents);
+
+    for (const string& note : page.notes)
+        cout << note << endl;
+
+    pmr::vector<MisorderedPair> misorderedTables = findMisorderedTables(page.tables, page.arena.get(), document.numbering);
+
+    for (const auto& table : page.tables) {
+        string_view trimmedTitle = trim(table.title);
+        const char* role = table.role == CaptionRole::Continuation ? " (продолжение)"
+            : table.role == CaptionRole::End ? " (окончание)" : "";
+        if (table.type == tableCaptionType) {
+            cout << "Номер таблицы: " << table.number << role << endl;
+            if (trimmedTitle.empty())
+                cout << "Название таблицы отсутствует" << endl;
+            else
+                cout << "Название таблицы: " << trimmedTitle << endl;
+        }
+        else {
+            cout << "Подпись: " << table.type << " " << table.number << role << endl;
+            if (trimmedTitle.empty())
+                cout << "Название отсутствует" << endl;
+            else
+                cout << "Название: " << trimmedTitle << endl;
+        }
+        cout << "----" << endl;
+    }
+
+    // Отчёт о нумерации выводится отдельно для каждого типа подписей в порядке их появления.
+    vector<string_view> reportedTypes;
+    for (const MisorderedPair& first : misorderedTables) {
+        if (find(reportedTypes.begin(), reportedTypes.end(), first.type) != reportedTypes.end())
+            continue;
+        reportedTypes.push_back(first.type);
+        if (first.type == tableCaptionType)
+            cout << "\nНеправильно пронумерованы таблицы: ";
+        else
+            cout << "\nНеправильно пронумерованы подписи «" << first.type << "»: ";
+        for (const MisorderedPair& pair : misorderedTables) {
+            if (pair.type == first.type)
+                cout << pair.number << " " << pair.previous << " ";
+        }
+        cout << endl;
+    }
+
+    for (const cv::Rect& box : page.uncaptioned) {
+        cout << "Таблица без подписи: x=" << box.x << " y=" << box.y
+            << " ширина=" << box.width << " высота=" << box.height << endl;
+    }
+}
+
+/**
+ * @brief Распознаёт подписи всех страниц пакета одной мозаикой и выводит страницы.
+ *
+ * Полосы над и под каждой таблицей всех страниц пакета распознаются одним
+ * вызовом recognizeMosaic, что распределяет постоянные расходы Tesseract на
+ * вызов между сотнями подписей.
+ *
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param batch Накопленные страницы; очищается после вывода.
+ * @param engines Пул экземпляров Tesseract.
+ * @param withHeader Печатать ли заголовки страниц.
+ * @param document Состояние проверок документа.
+ */
+void flushMosaic(const Options& options, const CaptionScanner& scanner, vector<PendingPage>& batch,
+    vector<unique_ptr<tesseract::TessBaseAPI>>& engines, bool withHeader, DocumentState& document) {
+    vector<cv::Mat> crops;
+    // Для каждого фрагмента — номер страницы в пакете и номер полосы на ней.
+    vector<pair<size_t, size_t>> owners;
+    vector<vector<vector<OcrLine>>> bandLines(batch.size());
+    for (size_t p = 0; p < batch.size(); ++p) {
+        const auto& regions = batch[p].regions;
+        bandLines[p].resize(regions.size() * 2);
+        for (size_t t = 0; t < regions.size(); ++t) {
+            for (int side = 0; side < 2; ++side) {
+                const cv::Rect& band = side == 0 ? regions[t].captionAbove : regions[t].captionBelow;
+                if (band.empty())
+                    continue;
+                crops.push_back(batch[p].img(band));
+                owners.emplace_back(p, 2 * t + side);
+            }
+        }
+    }
+
+    if (!crops.empty()) {
+        vector<vector<OcrLine>> lines = recognizeMosaic(engines[0].get(), crops);
+        for (size_t k = 0; k < crops.size(); ++k)
+            bandLines[owners[k].first][owners[k].second] = move(lines[k]);
+    }
+
+    for (size_t p = 0; p < batch.size(); ++p) {
+        PendingPage& page = batch[p];
+        if (page.result.skipReason.empty())
+            processTablePage(options, scanner, page.img, page.regions, engines, &bandLines[p], page.result);
+        restorePageScale(page);
+        emitPage(page.result, withHeader, document);
+    }
+    batch.clear();
+}
+
+/**
+ * @brief Заключает аргумент командной строки Windows в кавычки.
+ *
+ * Обратные косые черты перед кавычкой удваиваются, как того требует
+ * разбор командной строки CRT.
+ */
+string quoteArgument(const string& arg) {
+    string quoted = "\"";
+    size_t slashes = 0;
+    for (char c : arg) {
+        if (c == '\\') {
+            ++slashes;
+        }
+        else {
+            if (c == '"')
+                quoted.append(slashes + 1, '\\');
+            slashes = 0;
+        }
+        quoted += c;
+    }
+    quoted.append(slashes, '\\');
+    return quoted + "\"";
+}
+
+/**
+ * @struct ChildProcess
+ * @brief Дочерний процесс с каналами к его стандартному вводу и выводу.
+ *
+ * @var ChildProcess::input
+ * Конец канала для записи в stdin процесса или nullptr, если stdin подключён к NUL.
+ * @var ChildProcess::pending
+ * Прочитанный, но ещё не разобранный на строки вывод.
+ */
+struct ChildProcess {
+    HANDLE process = nullptr;
+    HANDLE input = nullptr;
+    HANDLE output = nullptr;
+    string pending;
+};
+
+/**
+ * @brief Запускает процесс с каналом из его стандартного вывода.
+ *
+ * Вывод ошибок процесса подключается к NUL. Стандартный ввод — канал,
+ * если withInput, иначе тоже NUL, поэтому ожидание Enter в конце GetTable
+ * не задерживает дочерний процесс.
+ *
+ * @param commandLine Командная строка.
+ * @param withInput Открыть ли канал в стандартный ввод процесса.
+ * @param child Запущенный процесс.
+ * @param environment Блок окружения процесса (environmentWith) или nullptr, чтобы унаследовать текущее.
+ * @return false, если процесс не запустился.
+ */
+bool startProcess(const string& commandLine, bool withInput, ChildProcess& child,
+    const vector<char>* environment = nullptr) {
+    SECURITY_ATTRIBUTES inherit = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+    HANDLE outputRead = nullptr, outputWrite = nullptr, inputRead = nullptr, inputWrite = nullptr;
+    if (!CreatePipe(&outputRead, &outputWrite, &inherit, 0))
+        return false;
+    SetHandleInformation(outputRead, HANDLE_FLAG_INHERIT, 0);
+    if (withInput && CreatePipe(&inputRead, &inputWrite, &inherit, 0))
+        SetHandleInformation(inputWrite, HANDLE_FLAG_INHERIT, 0);
+    HANDLE nul = CreateFileA("NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &inherit,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = inputRead ? inputRead : nul;
+    startup.hStdOutput = outputWrite;
+    startup.hStdError = nul;
+    PROCESS_INFORMATION process = {};
+    vector<char> mutableCommand(commandLine.begin(), commandLine.end());
+    mutableCommand.push_back('\0');
+    const BOOL started = CreateProcessA(nullptr, mutableCommand.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW,
+        environment ? const_cast<char*>(environment->data()) : nullptr, nullptr, &startup, &process);
+    CloseHandle(outputWrite);
+    CloseHandle(nul);
+    if (inputRead)
+        CloseHandle(inputRead);
+    if (!started) {
+        CloseHandle(outputRead);
+        if (inputWrite)
+            CloseHandle(inputWrite);
+        return false;
+    }
+
+    CloseHandle(process.hThread);
+    child.process = process.hProcess;
+    child.input = inputWrite;
+    child.output = outputRead;
+    child.pending.clear();
+    return true;
+}
+
+/**
+ * @brief Читает из вывода процесса одну строку.
+ * @param child Процесс.
+ * @param line Строка без перевода строки и возврата каретки.
+ * @return false, если вывод закончился раньше конца строки.
+ */
+bool readLine(ChildProcess& child, string& line) {
+    size_t end;
+    while ((end = child.pending.find('\n')) == string::npos) {
+        char buffer[4096];
+        DWORD bytesRead = 0;
+        if (!ReadFile(child.output, buffer, sizeof(buffer), &bytesRead, nullptr) || bytesRead == 0)
+            return false;
+        child.pending.append(buffer, bytesRead);
+    }
+    line.assign(child.pending, 0, end);
+    child.pending.erase(0, end + 1);
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    return true;
+}
+
+/**
+ * @brief Закрывает ввод процесса, дожидается его завершения и освобождает описатели.
+ * @param child Процесс.
+ * @return Код завершения процесса.
+ */
+int finishProcess(ChildProcess& child) {
+    if (child.input)
+        CloseHandle(child.input);
+    DWORD exitCode = 0;
+    if (child.process) {
+        WaitForSingleObject(child.process, INFINITE);
+        GetExitCodeProcess(child.process, &exitCode);
+        CloseHandle(child.process);
+    }
+    if (child.output)
+        CloseHandle(child.output);
+    child = ChildProcess();
+    return int(exitCode);
+}
+
+/**
+ * @brief Запускает процесс и собирает его стандартный вывод.
+ * @param commandLine Командная строка.
+ * @param output Стандартный вывод процесса.
+ * @param environment Блок окружения процесса или nullptr, чтобы унаследовать текущее.
+ * @return Код завершения процесса или -1, если процесс не запустился.
+ */
+int runProcess(const string& commandLine, string& output, const vector<char>* environment = nullptr) {
+    ChildProcess child;
+    if (!startProcess(commandLine, false, child, environment))
+        return -1;
+    string line;
+    while (readLine(child, line))
+        output += line + '\n';
+    output += child.pending;
+    return finishProcess(child);
+}
+
+/**
+ * @brief Собирает блок окружения текущего процесса с заменёнными переменными.
+ * @param variables Имена и значения задаваемых переменных.
+ * @return Блок для CreateProcess: строки «имя=значение», в конце пустая строка.
+ */
+vector<char> environmentWith(const vector<pair<string, string>>& variables) {
+    vector<char> block;
+    if (char* strings = GetEnvironmentStringsA()) {
+        for (const char* entry = strings; *entry; entry += strlen(entry) + 1) {
+            const size_t length = strlen(entry);
+            const bool replaced = any_of(variables.begin(), variables.end(), [&](const auto& variable) {
+                const string& name = variable.first;
+                return length > name.size() && entry[name.size()] == '=' && _strnicmp(entry, name.c_str(), name.size()) == 0;
+                });
+            if (!replaced)
+                block.insert(block.end(), entry, entry + length + 1);
+        }
+        FreeEnvironmentStringsA(strings);
+    }
+    for (const auto& [name, value] : variables) {
+        const string entry = name + "=" + value;
+        block.insert(block.end(), entry.begin(), entry.end());
+        block.push_back('\0');
+    }
+    block.push_back('\0');
+    return block;
+}
+
+/**
+ * @brief Окружение процесса с пределом потоков OpenMP.
+ *
+ * Среда OpenMP читает переменные при загрузке своей библиотеки, то есть
+ * вместе с Tesseract, до main, поэтому предел можно задать только новому
+ * процессу. OMP_THREAD_LIMIT понимают libgomp и libomp; vcomp из MSVC
+ * (OpenMP 2.0) его не знает и ограничивается через OMP_NUM_THREADS.
+ *
+ * @param threads Предел потоков.
+ * @return Блок окружения для CreateProcess.
+ */
+vector<char> ompEnvironment(int threads) {
+    const string limit = to_string(threads);
+    return environmentWith({ { "OMP_THREAD_LIMIT", limit }, { "OMP_NUM_THREADS", limit } });
+}
+
+/**
+ * @brief Проверяет, задан ли уже этому процессу предел потоков OpenMP.
+ * @param threads Предел потоков.
+ * @return true, если окружение процесса совпадает с ompEnvironment(threads).
+ */
+bool ompLimitApplied(int threads) {
+    const char* limit = getenv("OMP_THREAD_LIMIT");
+    const char* count = getenv("OMP_NUM_THREADS");
+    return limit && count && to_string(threads) == limit && to_string(threads) == count;
+}
+
+/**
+ * @brief Проверяет, загружена ли вместе с Tesseract библиотека OpenMP.
+ *
+ * Tesseract, собранный без OpenMP, распознаёт страницу в одном потоке,
+ * и --omp-threads ничего не меняет.
+ *
+ * @return true, если в процессе есть одна из известных сред OpenMP.
+ */
+bool openMpLoaded() {
+    for (const char* runtime : { "vcomp140.dll", "vcomp140d.dll", "libgomp-1.dll", "libomp.dll", "libomp140.x86_64.dll",
+        "libiomp5md.dll" }) {
+        if (GetModuleHandleA(runtime))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Перезапускает GetTable с той же командной строкой и другим окружением.
+ *
+ * Новый процесс работает в той же консоли с теми же стандартными потоками,
+ * а текущий только ждёт его завершения.
+ *
+ * @param commandLine Командная строка.
+ * @param environment Блок окружения нового процесса.
+ * @return Код завершения нового процесса или -1, если он не запустился.
+ */
+int rerunWithEnvironment(const string& commandLine, const vector<char>& environment) {
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION process = {};
+    vector<char> mutableCommand(commandLine.begin(), commandLine.end());
+    mutableCommand.push_back('\0');
+    if (!CreateProcessA(nullptr, mutableCommand.data(), nullptr, nullptr, TRUE, 0, const_cast<char*>(environment.data()),
+        nullptr, &startup, &process))
+        return -1;
+    CloseHandle(process.hThread);
+    WaitForSingleObject(process.hProcess, INFINITE);
+    DWORD exitCode = 0;
+    GetExitCodeProcess(process.hProcess, &exitCode);
+    CloseHandle(process.hProcess);
+    return int(exitCode);
+}
+
+/**
+ * @brief Командная строка для запуска GetTable с параметрами текущего запуска.
+ * @param options Параметры запуска; передаются все, кроме изображений и распределения потоков.
+ * @param extra Дополнительные параметры.
+ * @return Командная строка или пустая строка, если путь к программе неизвестен.
+ */
+string selfCommandLine(const Options& options, const string& extra) {
+    char exePath[MAX_PATH] = {};
+    if (GetModuleFileNameA(nullptr, exePath, MAX_PATH) == 0)
+        return {};
+    string command = quoteArgument(exePath) + " " + extra;
+    for (const string& arg : options.arguments)
+        command += " " + quoteArgument(arg);
+    return command;
+}
+
+/**
+ * @brief Подбирает число потоков страниц и предел потоков OpenMP пробными прогонами.
+ *
+ * Предел потоков OpenMP читается при загрузке Tesseract, поэтому каждое
+ * разбиение ядер проверяется отдельным запуском GetTable, которому предел
+ * задаётся в окружении (ompEnvironment). Все запуски распознают одни и те
+ * же первые страницы пакета, а время обработки в них не включает Init.
+ * Внутренние потоки перебираются степенями двойки, внешние занимают
+ * остальные ядра с учётом --strips. Выбирается разбиение с наибольшим
+ * числом страниц в секунду.
+ *
+ * @param options Параметры запуска; при успехе задаются pageWorkers и ompThreads.
+ * @return true, если хотя бы один пробный прогон удался.
+ */
+bool calibrateSplit(Options& options) {
+    const int cores = max(1, int(thread::hardware_concurrency()));
+    const int strips = max(options.stripWorkers, 1);
+    const string timeLabel = "Время обработки: ";
+    // Мозаика собирает страницы в пакеты сама и не распознаёт их параллельно.
+    auto outerFor = [&](int inner) { return options.mosaicPages > 0 ? 1 : max(1, cores / (inner * strips)); };
+    // Выборка по самому широкому разбиению: каждому потоку страниц хотя бы по две страницы.
+    const size_t sampleSize = min(options.images.size(), size_t(max(8, 2 * outerFor(1))));
+
+    double bestRate = 0;
+    for (int inner = 1; inner <= cores; inner *= 2) {
+        const int outer = outerFor(inner);
+        string command = selfCommandLine(options, "--report-time --omp-threads " + to_string(inner)
+            + " --page-workers " + to_string(outer));
+        if (command.empty())
+            return false;
+        for (size_t i = 0; i < sampleSize; ++i)
+            command += " " + quoteArgument(options.images[i]);
+
+        string output;
+        const vector<char> environment = ompEnvironment(inner);
+        if (runProcess(command, output, &environment) < 0)
+            continue;
+        const size_t label = output.rfind(timeLabel);
+        if (label == string::npos)
+            continue;
+        const double ms = max(1.0, atof(output.c_str() + label + timeLabel.size()));
+        const double rate = sampleSize * 1000.0 / ms;
+        cout << "Калибровка: " << outer << " x " << inner << " потоков — " << rate << " стр/с" << endl;
+        if (rate > bestRate) {
+            bestRate = rate;
+            options.pageWorkers = outer;
+            options.ompThreads = inner;
+        }
+    }
+    return bestRate > 0;
+}
+
+/**
+ * @brief Проверяет страницу перед распознаванием: пустые страницы и поиск таблиц по линиям.
+ * @param options Параметры запуска.
+ * @param img Изображение страницы.
+ * @param page Страница; заполняются причина пропуска, рамки таблиц и сообщения.
+ */
+void preparePage(const Options& options, const cv::Mat& img, PendingPage& page) {
+    // Статистика чернил нужна и модели стоимости, поэтому считается и без отбраковки пустых страниц.
+    page.result.cost.pixels = double(img.total());
+    page.result.cost.colour = img.channels() > 1;
+    page.result.cost.ink = measureInk(img);
+    if (options.skipBlank)
+        mayContainCaption(page.result.cost.ink, page.result.skipReason);
+
+    if (page.result.skipReason.empty() && options.detectTables) {
+        // Распознаются только полосы рядом с найденными таблицами.
+        page.regions = detectTables(img);
+        if (page.regions.empty())
+            page.result.notes.push_back("Таблицы на странице не найдены");
+    }
+}
+
+/**
+ * @brief Распознаёт подписи страницы способом, выбранным параметрами запуска.
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param templates Образцы ключевого слова для поиска по форме.
+ * @param img Изображение страницы.
+ * @param page Страница, подготовленная preparePage.
+ * @param engines Экземпляры Tesseract, принадлежащие вызывающему потоку.
+ * @param deadline Срок страницы или nullptr.
+ */
+void recognizePage(const Options& options, const CaptionScanner& scanner, const vector<KeywordTemplate>& templates,
+    const cv::Mat& img, PendingPage& page, vector<unique_ptr<tesseract::TessBaseAPI>>& engines,
+    const PageDeadline* deadline) {
+    if (options.detectTables)
+        processTablePage(options, scanner, img, page.regions, engines, nullptr, page.result, deadline);
+    else if (options.spotKeywords)
+        processSpottedPage(options, scanner, img, templates, engines, page.result, deadline);
+    else
+        processTextPage(options, scanner, img, engines, page.result, deadline);
+}
+
+/**
+ * @brief Распознаёт подписи страницы с учётом срока распознавания.
+ *
+ * Если срок (--deadline) истёк, Tesseract прерывается, а результат
+ * страницы отбрасывается. По политике "downscale" страница распознаётся
+ * ещё раз в половинном масштабе с новым сроком и вдвое меньшим
+ * user_defined_dpi: на шумных и полутоновых страницах это в разы быстрее,
+ * а подписи обычно остаются читаемыми.
+ * Если не уложилась и повторная попытка (или политика "skip"), страница
+ * пропускается с причиной, видимой в отчёте.
+ *
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param templates Образцы ключевого слова для поиска по форме.
+ * @param img Изображение страницы.
+ * @param page Страница, подготовленная preparePage.
+ * @param engines Экземпляры Tesseract, принадлежащие вызывающему потоку.
+ */
+void processPage(const Options& options, const CaptionScanner& scanner, const vector<KeywordTemplate>& templates,
+    const cv::Mat& img, PendingPage& page, vector<unique_ptr<tesseract::TessBaseAPI>>& engines) {
+    if (!page.result.skipReason.empty())
+        return;
+    if (options.pageDeadline <= 0) {
+        recognizePage(options, scanner, templates, img, page, engines, nullptr);
+        return;
+    }
+
+    // Результат прерванного распознавания неполон; память арены остаётся до вывода страницы.
+    // Сообщения загрузки и подготовки (масштаб, страницы TIFF) к распознаванию не относятся и сохраняются.
+    const size_t preparedNotes = page.result.notes.size();
+    auto discardResult = [&] {
+        page.result.tables.clear();
+        page.result.references.clear();
+        page.result.contents.clear();
+        page.result.uncaptioned.clear();
+        page.result.notes.resize(preparedNotes);
+        page.regions.clear();
+    };
+    const string reason = "превышено время распознавания (" + to_string(options.pageDeadline) + " мс)";
+
+    const PageDeadline deadline(options.pageDeadline);
+    recognizePage(options, scanner, templates, img, page, engines, &deadline);
+    if (!deadline.interrupted)
+        return;
+    discardResult();
+
+    if (options.timeoutPolicy == "downscale") {
+        cv::Mat smaller;
+        cv::resize(img, smaller, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+        preparePage(options, smaller, page);
+        // Сообщения повторной подготовки повторяют уже сохранённые.
+        page.result.notes.resize(preparedNotes);
+        if (!page.result.skipReason.empty())
+            return;
+        int dpi = 0;
+        engines[0]->GetIntVariable("user_defined_dpi", &dpi);
+        setPageResolution(engines, dpi / 2);
+        const PageDeadline retry(options.pageDeadline);
+        recognizePage(options, scanner, templates, smaller, page, engines, &retry);
+        setPageResolution(engines, dpi);
+        if (!retry.interrupted) {
+            for (cv::Rect& box : page.result.uncaptioned)
+                box = cv::Rect(box.x * 2, box.y * 2, box.width * 2, box.height * 2);
+            page.result.notes.push_back(reason + ": страница распознана в половинном масштабе");
+            return;
+        }
+        discardResult();
+    }
+    page.result.skipReason = reason;
+}
+
+/**
+ * @brief Распределяет потоки страниц по узлам NUMA и ядрам.
+ *
+ * Потоки раздаются узлам по очереди, внутри узла каждому потоку достаётся
+ * coresPerWorker следующих свободных логических процессоров (по кругу,
+ * если потоков больше, чем ядер). Маски берутся с учётом групп процессоров,
+ * поэтому работают и на машинах с числом ядер больше 64.
+ *
+ * @param workerCount Число потоков страниц.
+ * @param coresPerWorker Процессоров на поток: полосы страницы, умноженные на предел потоков OpenMP.
+ * @return Маска процессоров для каждого потока или пустой вектор, если узлы не определены.
+ */
+vector<GROUP_AFFINITY> planWorkerPlacement(size_t workerCount, int coresPerWorker) {
+    ULONG highestNode = 0;
+    if (!GetNumaHighestNodeNumber(&highestNode))
+        return {};
+
+    struct NodeCores {
+        WORD group;
+        vector<int> processors;
+        size_t next = 0;
+    };
+    vector<NodeCores> nodes;
+    for (ULONG node = 0; node <= highestNode; ++node) {
+        GROUP_AFFINITY mask = {};
+        if (!GetNumaNodeProcessorMaskEx(USHORT(node), &mask) || mask.Mask == 0)
+            continue;
+        NodeCores cores{ mask.Group, {} };
+        for (int bit = 0; bit < int(sizeof(KAFFINITY) * 8); ++bit)
+            if (mask.Mask & (KAFFINITY(1) << bit))
+                cores.processors.push_back(bit);
+        nodes.push_back(move(cores));
+    }
+    if (nodes.empty())
+        return {};
+
+    vector<GROUP_AFFINITY> placement(workerCount);
+    for (size_t w = 0; w < workerCount; ++w) {
+        NodeCores& node = nodes[w % nodes.size()];
+        placement[w].Group = node.group;
+        for (int k = 0; k < max(coresPerWorker, 1); ++k) {
+            placement[w].Mask |= KAFFINITY(1) << node.processors[node.next];
+            node.next = (node.next + 1) % node.processors.size();
+        }
+    }
+    return placement;
+}
+
+/**
+ * @brief Проверяет, есть ли на странице первая подпись таблицы.
+ *
+ * Только такие подписи сверяются с перечнем таблиц, и только для них нужен
+ * номер страницы по колонтитулу (recognizePageNumber).
+ *
+ * @param page Распознанная страница.
+ * @return true, если на странице начинается таблица.
+ */
+bool startsTable(const PageResult& page) {
+    return any_of(page.tables.begin(), page.tables.end(), [](const TableInfo& table) {
+        return table.type == tableCaptionType && table.role == CaptionRole::Start;
+        });
+}
+
+/**
+ * @brief Загружает и распознаёт одну страницу вне пакета мозаики.
+ *
+ * Номер страницы по колонтитулу при распознавании всей страницы нужен
+ * только для сверки первых подписей таблиц с перечнем. При параллельной
+ * обработке перечень может быть найден позже, чем обработаны страницы
+ * после него, поэтому номер читается, если readPageNumber, но только на
+ * страницах с такими подписями.
+ *
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param templates Образцы ключевого слова для поиска по форме.
+ * @param path Путь к изображению.
+ * @param engines Экземпляры Tesseract вызывающего потока.
+ * @param pageNumber Уже распознанный номер страницы или 0.
+ * @param readPageNumber Распознавать ли номер страницы с подписью таблицы, если он ещё не известен.
+ * @param reduction Наименьшее уменьшение изображения при чтении (planPageRead).
+ * @return Обработанная страница; при ошибке заполнено поле error.
+ */
+unique_ptr<PendingPage> loadAndProcessPage(const Options& options, const CaptionScanner& scanner,
+    const vector<KeywordTemplate>& templates, const string& path, vector<unique_ptr<tesseract::TessBaseAPI>>& engines,
+    int pageNumber, bool readPageNumber, int reduction) {
+    auto page = make_unique<PendingPage>();
+    cv::Mat img = loadPage(options, path, reduction, *page, &engines);
+    if (img.empty()) {
+        page->error = "изображение не загружено: " + path;
+        return page;
+    }
+    preparePage(options, img, *page);
+    page->result.pageNumber = pageNumber;
+    const auto started = chrono::steady_clock::now();
+    processPage(options, scanner, templates, img, *page, engines);
+    if (page->result.skipReason.empty())
+        page->result.cost.ocrMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+    if (pageNumber == 0 && readPageNumber && startsTable(page->result))
+        page->result.pageNumber = recognizePageNumber(engines[0].get(), img);
+    restorePageScale(*page);
+    return page;
+}
+
+/**
+ * @struct MemoryBudget
+ * @brief Допуск страниц к распознаванию по оценке занимаемой памяти.
+ *
+ * Страницы допускаются в порядке очереди, пока сумма их оценок не
+ * превышает limit; очередная страница ждёт освобождения памяти, и
+ * страницы после неё не обгоняют её, иначе большая страница могла бы
+ * ждать бесконечно. Оценка страницы, не укладывающейся в бюджет и в
+ * одиночку, ограничивается limit: такая страница распознаётся одна.
+ */
+struct MemoryBudget {
+    size_t limit = 0;
+    size_t used = 0;
+    size_t nextTicket = 0;
+    size_t serving = 0;
+    mutex lock;
+    condition_variable released;
+
+    /**
+     * @brief Ждёт, пока страница с данной оценкой уложится в бюджет, и занимает память.
+     * @return Занятая память, которую нужно вернуть release.
+     */
+    size_t admit(size_t footprint) {
+        footprint = min(footprint, limit);
+        unique_lock<mutex> guard(lock);
+        const size_t ticket = nextTicket++;
+        released.wait(guard, [&] { return ticket == serving && used + footprint <= limit; });
+        used += footprint;
+        ++serving;
+        released.notify_all();
+        return footprint;
+    }
+
+    void release(size_t footprint) {
+        {
+            lock_guard<mutex> guard(lock);
+            used -= footprint;
+        }
+        released.notify_all();
+    }
+};
+
+/**
+ * @brief Раздаёт страницы исполнителям с перехватом работы и выводит результаты по порядку.
+ *
+ * Время распознавания страниц различается на два порядка (пустая страница
+ * и страница с плотными таблицами), поэтому страницы не делятся между
+ * исполнителями заранее. Страницы раздаются по очереди в очереди
+ * исполнителей; исполнитель берёт страницы из начала своей очереди, а
+ * опустев — забирает страницу из конца очереди другого. С largestFirst
+ * очереди упорядочены по убыванию прогноза модели стоимости (--cost-model),
+ * а без модели — по убыванию размера изображения: длинные страницы
+ * начинаются первыми, а под конец пакета перехватываются короткие.
+ *
+ * Результаты выводятся в порядке документа по мере готовности, поэтому
+ * проверки нумерации, ссылок и перечня работают так же, как без потоков.
+ *
+ * Страницы, уже записанные в журнал прошлым запуском, берутся из него
+ * без распознавания.
+ *
+ * С бюджетом памяти (--memory-budget) исполнитель перед страницей
+ * оценивает её память по заголовку файла (planPageRead) и ждёт допуска
+ * MemoryBudget. Страница, которая не укладывается в бюджет и одна,
+ * читается уменьшенной; страница неизвестного формата занимает весь бюджет.
+ *
+ * С --report-time исполнители после startWorker ждут друг друга, и время
+ * обработки отсчитывается от document.enginesReady: загрузка моделей
+ * Tesseract не попадает в замер, по которому calibrateSplit сравнивает
+ * разбиения ядер.
+ *
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей (для чтения журнала).
+ * @param workerCount Число исполнителей; у каждого свой поток.
+ * @param startWorker Подготовка исполнителя в его потоке; false — исполнитель не берёт страниц.
+ * @param runJob Обработка страницы с данным номером данным исполнителем и уменьшением при чтении.
+ * @param withHeader Печатать ли заголовки страниц.
+ * @param document Состояние проверок документа.
+ * @return 0; -1, если какая-либо страница не обработана; 1, если не запустился ни один исполнитель.
+ */
+int schedulePages(const Options& options, const CaptionScanner& scanner, size_t workerCount,
+    const function<bool(size_t)>& startWorker,
+    const function<unique_ptr<PendingPage>(size_t, size_t, int)>& runJob, bool withHeader, DocumentState& document) {
+    const vector<string>& images = options.images;
+    MemoryBudget budget;
+    budget.limit = options.memoryBudget;
+
+    vector<size_t> order(images.size());
+    iota(order.begin(), order.end(), size_t(0));
+    if (options.largestFirst && document.progress) {
+        vector<double> sizes(images.size());
+        for (size_t i = 0; i < images.size(); ++i)
+            sizes[i] = document.progress->predicted[images[i]];
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+    }
+    else if (options.largestFirst) {
+        // Время распознавания растёт с числом пикселей; размер файла — только для неизвестных форматов.
+        vector<uintmax_t> sizes(images.size());
+        for (size_t i = 0; i < images.size(); ++i) {
+            ImageInfo info;
+            if (probeImage(images[i], info)) {
+                sizes[i] = uintmax_t(info.size.width) * uintmax_t(info.size.height);
+                continue;
+            }
+            error_code error;
+            sizes[i] = filesystem::file_size(images[i], error);
+            if (error)
+                sizes[i] = 0;
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+    }
+
+    struct WorkerQueue {
+        mutex lock;
+        deque<size_t> jobs;
+    };
+    vector<WorkerQueue> queues(workerCount);
+    for (size_t k = 0; k < order.size(); ++k)
+        queues[k % workerCount].jobs.push_back(order[k]);
+
+    auto takeJob = [&](size_t w, size_t& job) {
+        {
+            lock_guard<mutex> guard(queues[w].lock);
+            if (!queues[w].jobs.empty()) {
+                job = queues[w].jobs.front();
+                queues[w].jobs.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < workerCount; ++k) {
+            WorkerQueue& victim = queues[(w + k) % workerCount];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.back();
+                victim.jobs.pop_back();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Готовые страницы ждут вывода, пока не выведены все предыдущие.
+    vector<unique_ptr<PendingPage>> results(images.size());
+    mutex resultsLock;
+    condition_variable resultReady;
+    // Исполнители, которые ещё могут выдать результат; вывод не ждёт, если их не осталось.
+    size_t liveWorkers = workerCount;
+    size_t startingWorkers = workerCount;
+    condition_variable allStarted;
+
+    auto worker = [&](size_t w) {
+        const bool ready = startWorker(w);
+        if (options.reportTime) {
+            unique_lock<mutex> guard(resultsLock);
+            if (--startingWorkers == 0) {
+                document.enginesReady = chrono::steady_clock::now();
+                allStarted.notify_all();
+            }
+            allStarted.wait(guard, [&] { return startingWorkers == 0; });
+        }
+        size_t job;
+        while (ready && takeJob(w, job)) {
+            unique_ptr<PendingPage> page = resumePage(document.journal, scanner, images[job]);
+            if (!page && budget.limit == 0) {
+                page = runJob(w, job, 1);
+            }
+            else if (!page) {
+                const PageRead plan = planPageRead(options, images[job], 1);
+                const size_t held = budget.admit(plan.footprint);
+                page = runJob(w, job, plan.reduction);
+                budget.release(held);
+            }
+            lock_guard<mutex> guard(resultsLock);
+            results[job] = move(page);
+            resultReady.notify_all();
+        }
+
+        lock_guard<mutex> guard(resultsLock);
+        --liveWorkers;
+        resultReady.notify_all();
+    };
+
+    vector<thread> threads;
+    for (size_t w = 0; w < workerCount; ++w)
+        threads.emplace_back(worker, w);
+
+    int exitCode = 0;
+    for (size_t i = 0; i < images.size(); ++i) {
+        unique_ptr<PendingPage> page;
+        {
+            unique_lock<mutex> guard(resultsLock);
+            resultReady.wait(guard, [&] { return results[i] != nullptr || liveWorkers == 0; });
+            page = move(results[i]);
+        }
+        if (!page) {
+            exitCode = 1;
+            break;
+        }
+        if (!page->error.empty()) {
+            cerr << "Ошибка: " << page->error << endl;
+            exitCode = -1;
+            continue;
+        }
+        emitPage(page->result, withHeader, document);
+    }
+
+    for (thread& t : threads)
+        t.join();
+    return exitCode;
+}
+
+/**
+ * @brief Распознаёт страницы несколькими потоками этого процесса.
+ *
+ * Недостающие экземпляры Tesseract создаются в самих потоках, параллельно.
+ * С pinWorkers поток сначала закрепляется за своими ядрами (planWorkerPlacement),
+ * и уже затем загружает модель и читает изображения: Windows выделяет
+ * память на узле потока, который первым к ней обращается, поэтому у
+ * каждого узла оказывается своя копия traineddata и свои буферы страниц.
+ *
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param templates Образцы ключевого слова для поиска по форме.
+ * @param workerEngines Экземпляры Tesseract каждого потока; дополняются до нужного числа.
+ * @param pageNumbers Уже распознанные номера страниц по пути к изображению.
+ * @param withHeader Печатать ли заголовки страниц.
+ * @param document Состояние проверок документа.
+ * @return Код завершения, как у schedulePages.
+ */
+int processPagesInParallel(const Options& options, const CaptionScanner& scanner, const vector<KeywordTemplate>& templates,
+    vector<vector<unique_ptr<tesseract::TessBaseAPI>>>& workerEngines, const unordered_map<string, int>& pageNumbers,
+    bool withHeader, DocumentState& document) {
+    const size_t workerCount = workerEngines.size();
+    const bool readPageNumbers = !options.detectTables && !options.spotKeywords;
+    // Потоки полос и ячеек наследуют маску потока страниц (startSiblingThread), поэтому она рассчитана и на них.
+    const vector<GROUP_AFFINITY> placement = options.pinWorkers
+        ? planWorkerPlacement(workerCount, max(options.stripWorkers, 1) * max(options.ompThreads, 1))
+        : vector<GROUP_AFFINITY>();
+
+    auto startWorker = [&](size_t w) {
+        if (w < placement.size())
+            SetThreadGroupAffinity(GetCurrentThread(), &placement[w], nullptr);
+        return ensureEngines(options, workerEngines[w], max(options.stripWorkers, 1));
+    };
+    auto runJob = [&](size_t w, size_t job, int reduction) {
+        const string& path = options.images[job];
+        auto known = pageNumbers.find(path);
+        return loadAndProcessPage(options, scanner, templates, path, workerEngines[w],
+            known != pageNumbers.end() ? known->second : 0, readPageNumbers, reduction);
+    };
+    return schedulePages(options, scanner, workerCount, startWorker, runJob, withHeader, document);
+}
+
+/**
+ * @brief Распознаёт страницы в дочерних процессах GetTable.
+ *
+ * Windows не умеет fork, поэтому модель не наследуется готовой: каждый
+ * процесс запускается с --serve и вызывает Init сам. Зато падение
+ * Tesseract на испорченном изображении завершает только свой процесс:
+ * страница помечается необработанной, процесс перезапускается, и пакет
+ * продолжается. Страницы раздаются процессам через очереди schedulePages,
+ * по одной: путь пишется в stdin процесса, результат читается из stdout
+ * строкой encodePage. С --cells каждому процессу достаётся доля --workers,
+ * чтобы всего экземпляров Tesseract для ячеек было столько же, сколько
+ * в одном процессе.
+ *
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param withHeader Печатать ли заголовки страниц.
+ * @param document Состояние проверок документа.
+ * @return Код завершения, как у schedulePages.
+ */
+int processPagesInProcesses(const Options& options, const CaptionScanner& scanner, bool withHeader,
+    DocumentState& document) {
+    string extra = "--serve";
+    if (options.ompThreads > 0)
+        extra += " --omp-threads " + to_string(options.ompThreads);
+    string command = selfCommandLine(options, extra);
+    if (command.empty()) {
+        cerr << "Ошибка: не удалось определить путь к программе." << endl;
+        return 1;
+    }
+    // Пул ячеек делится между процессами; стоит после параметров запуска, чтобы заменить их --workers.
+    if (!options.cellFormat.empty())
+        command += " --workers " + to_string(max(1, options.workers / options.processes));
+
+    const vector<char> environment = options.ompThreads > 0 ? ompEnvironment(options.ompThreads) : vector<char>();
+    const vector<char>* childEnvironment = environment.empty() ? nullptr : &environment;
+
+    vector<ChildProcess> children(options.processes);
+    auto startWorker = [&](size_t w) {
+        if (startProcess(command, true, children[w], childEnvironment))
+            return true;
+        cerr << "Ошибка: не удалось запустить процесс распознавания." << endl;
+        return false;
+    };
+    auto runJob = [&](size_t w, size_t job, int reduction) {
+        ChildProcess& child = children[w];
+        const string& path = options.images[job];
+        auto page = make_unique<PendingPage>();
+
+        const string request = path + "\t" + to_string(options.pageDeadline) + "\t" + to_string(reduction) + "\n";
+        DWORD written = 0;
+        string record;
+        const bool answered = child.process && WriteFile(child.input, request.data(), DWORD(request.size()), &written, nullptr)
+            && readLine(child, record);
+        if (answered && decodePage(record, scanner, page->result))
+            return page;
+        if (answered && record.rfind("!", 0) == 0) {
+            page->error = unescapeField(string_view(record).substr(1));
+            return page;
+        }
+
+        page->error = "процесс распознавания завершился аварийно на странице " + path;
+        finishProcess(child);
+        startProcess(command, true, child, childEnvironment);
+        return page;
+    };
+
+    const int exitCode = schedulePages(options, scanner, children.size(), startWorker, runJob, withHeader, document);
+    for (ChildProcess& child : children)
+        finishProcess(child);
+    return exitCode;
+}
+
+/**
+ * @brief Режим дочернего процесса: распознаёт страницы, пути которых приходят в stdin.
+ *
+ * На каждую строку с путём выводится строка encodePage, а если страница
+ * не загрузилась — «!» и сообщение об ошибке. После пути через табуляцию
+ * может идти срок распознавания этой страницы в миллисекундах, заменяющий
+ * --deadline, и ещё через табуляцию — уменьшение при чтении, выбранное
+ * родителем по бюджету памяти. Работа заканчивается, когда родитель
+ * закрывает stdin. Экземпляров Tesseract для ячеек создаётся --workers,
+ * который родитель уже уменьшил до доли одного процесса.
+ *
+ * @param options Параметры запуска.
+ * @param scanner Сканер ключевых слов подписей.
+ * @param templates Образцы ключевого слова для поиска по форме.
+ * @param engines Экземпляры Tesseract.
+ * @return Код завершения процесса.
+ */
+int servePages(const Options& options, const CaptionScanner& scanner, const vector<KeywordTemplate>& templates,
+    vector<unique_ptr<tesseract::TessBaseAPI>>& engines) {
+    const bool readPageNumbers = !options.detectTables && !options.spotKeywords;
+    Options request = options;
+    string path;
+    while (getline(cin, path)) {
+        if (!path.empty() && path.back() == '\r')
+            path.pop_back();
+        request.pageDeadline = options.pageDeadline;
+        int reduction = 1;
+        if (const size_t tab = path.find('\t'); tab != string::npos) {
+            request.pageDeadline = max(0, atoi(path.c_str() + tab + 1));
+            if (const size_t next = path.find('\t', tab + 1); next != string::npos)
+                reduction = clamp(atoi(path.c_str() + next + 1), 1, 8);
+            path.resize(tab);
+        }
+        unique_ptr<PendingPage> page = loadAndProcessPage(request, scanner, templates, path, engines, 0, readPageNumbers,
+            reduction);
+        if (page->error.empty())
+            cout << encodePage(page->result) << '\n' << flush;
+        else
+            cout << '!' << escapeField(page->error) << '\n' << flush;
+    }
+    return 0;
+}
+
+/**
+ * @brief Точка входа в программу.
+ * Использует Tesseract и OpenCV для распознавания и анализа таблиц в изображении.
+ * @return Код завершения программы.
+ */
+int main(int argc, char* argv[]) {
+    SetConsoleOutputCP(CP_UTF8);
+
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    if (!options.fitCostLog.empty())
+        return fitCostModel(options.fitCostLog, options.costModelPath) ? 0 : 1;
+
+    _putenv_s("TESSDATA_PREFIX", tessdata_path);
+
+    if ((options.autoSplit || options.ompThreads > 0) && !openMpLoaded()) {
+        cerr << "Предупреждение: Tesseract собран без OpenMP, --omp-threads и --auto-split не влияют на распознавание."
+            << endl;
+        // Страница распознаётся в одном потоке, поэтому все ядра отдаются потокам страниц.
+        if (options.autoSplit && options.mosaicPages == 0 && options.processes == 0) {
+            options.pageWorkers = max(1, int(thread::hardware_concurrency()) / max(options.stripWorkers, 1));
+            cout << "Выбрано: " << options.pageWorkers << " потоков страниц" << endl;
+        }
+        options.ompThreads = 0;
+        options.autoSplit = false;
+    }
+    // Явный --omp-threads отменяет подбор, поэтому перезапуск ниже не калибрует заново.
+    if (options.autoSplit && options.ompThreads == 0) {
+        if (calibrateSplit(options))
+            cout << "Выбрано: " << options.pageWorkers << " потоков страниц x " << options.ompThreads
+                << " потоков OpenMP" << endl;
+        else
+            cerr << "Предупреждение: пробные прогоны не удались, потоки не настроены." << endl;
+    }
+    // Среда OpenMP читает предел при загрузке вместе с Tesseract, раньше main, поэтому
+    // GetTable перезапускается с ним в окружении. Дочерним процессам он задаётся при запуске.
+    if (options.ompThreads > 0 && options.processes == 0 && !ompLimitApplied(options.ompThreads)) {
+        const string command = string(GetCommandLineA()) + " --omp-threads " + to_string(options.ompThreads)
+            + " --page-workers " + to_string(options.pageWorkers);
+        const int code = rerunWithEnvironment(command, ompEnvironment(options.ompThreads));
+        if (code >= 0)
+            return code;
+        cerr << "Предупреждение: не удалось перезапустить GetTable с пределом потоков OpenMP." << endl;
+    }
+
+    vector<unique_ptr<tesseract::TessBaseAPI>> engines;
+    size_t enginesNeeded = max(options.stripWorkers, 1);
+    if (!options.cellFormat.empty())
+        enginesNeeded = max(enginesNeeded, size_t(options.workers));
+    // Родителю дочерних процессов Tesseract нужен только для восстановления порядка страниц,
+    // а закреплённые потоки страниц загружают модели сами, на своих узлах.
+    if (options.processes > 0 || (options.pageWorkers > 1 && options.pinWorkers))
+        enginesNeeded = options.reorderPages ? 1 : 0;
+    if (!ensureEngines(options, engines, enginesNeeded))
+        return 1;
+
+    const CaptionScanner scanner(options.keywords, options.keywordErrors);
+
+    vector<KeywordTemplate> keywordTemplates;
+    if (options.spotKeywords)
+        keywordTemplates = buildKeywordTemplates(options.spotTemplates);
+
+    if (options.serve)
+        return servePages(options, scanner, keywordTemplates, engines);
+
+    // Номера страниц, уже распознанные при восстановлении порядка.
+    unordered_map<string, int> pageNumbers;
+    if (options.reorderPages && orderPagesByNumber(options, options.images, engines[0].get(), pageNumbers))
+        cout << "Порядок страниц восстановлен по номерам в колонтитулах" << endl;
+
+    const bool withHeader = options.images.size() > 1;
+    vector<PendingPage> batch;
+    DocumentState document;
+    int exitCode = 0;
+    const auto started = chrono::steady_clock::now();
+
+    Journal journal;
+    if (!options.journalPath.empty()) {
+        string header = "GetTable journal 2";
+        for (const string& arg : options.arguments)
+            header += "\t" + escapeField(arg);
+        if (!openJournal(options.journalPath, header, journal))
+            return 1;
+        if (!journal.completed.empty())
+            cout << "Продолжение по журналу: уже обработано страниц: " << journal.completed.size() << endl;
+        document.journal = &journal;
+    }
+
+    unique_ptr<FILE, int (*)(FILE*)> costLog(nullptr, fclose);
+    if (!options.costLogPath.empty()) {
+        costLog.reset(fopen(options.costLogPath.c_str(), "a"));
+        if (!costLog) {
+            cerr << "Ошибка: не удалось открыть журнал стоимости " << options.costLogPath << endl;
+            return 1;
+        }
+        if (ftell(costLog.get()) == 0)
+            fprintf(costLog.get(), "path\tmegapixels\tfile_mb\tcolour\tink_ratio\tglyph_components\ttables\tocr_ms\n");
+        document.costLog = costLog.get();
+    }
+
+    Progress progress;
+    if (!options.costModelPath.empty()) {
+        CostModel model;
+        if (!loadCostModel(options.costModelPath, model)) {
+            cerr << "Ошибка: не удалось прочитать модель стоимости " << options.costModelPath << endl;
+            return 1;
+        }
+        for (const string& imagePath : options.images) {
+            double& ms = progress.predicted[imagePath];
+            ms = model.predict(pageCostFeatures(options, imagePath));
+            progress.remaining += ms;
+        }
+        progress.total = options.images.size();
+        const long long expected = llround(progress.remaining / 1000);
+        cout << "Прогноз распознавания: " << expected / 60 << " мин " << expected % 60 << " с в один поток" << endl;
+        document.progress = &progress;
+    }
+
+    if (options.processes > 0) {
+        engines.clear();
+        exitCode = processPagesInProcesses(options, scanner, withHeader, document);
+    }
+    else if (options.pageWorkers > 1) {
+        vector<vector<unique_ptr<tesseract::TessBaseAPI>>> workerEngines(options.pageWorkers);
+        // Закреплённые потоки загружают модель сами, на своём узле NUMA.
+        if (options.pinWorkers)
+            engines.clear();
+        else
+            workerEngines[0] = move(engines);
+        exitCode = processPagesInParallel(options, scanner, keywordTemplates, workerEngines, pageNumbers,
+            withHeader, document);
+    }
+    else {
+        for (const string& imagePath : options.images) {
+            if (unique_ptr<PendingPage> done = resumePage(document.journal, scanner, imagePath)) {
+                // В пакете мозаики у страницы из журнала нет таблиц, и распознавать в ней нечего.
+                if (options.mosaicPages > 0) {
+                    batch.push_back(move(*done));
+                    if (batch.size() >= size_t(options.mosaicPages))
+                        flushMosaic(options, scanner, batch, engines, withHeader, document);
+                }
+                else {
+                    emitPage(done->result, withHeader, document);
+                }
+                continue;
+            }
+
+            // Пакет мозаики распознаётся одним изображением, поэтому разрешение страницы Tesseract не задаётся.
+            PendingPage page;
+            cv::Mat img = loadPage(options, imagePath, 1, page, options.mosaicPages > 0 ? nullptr : &engines);
+
+            if (img.empty()) {
+                cerr << "Ошибка: изображение не загружено: " << imagePath << endl;
+                exitCode = -1;
+                continue;
+            }
+
+            preparePage(options, img, page);
+
+            const auto known = pageNumbers.find(imagePath);
+            if (known != pageNumbers.end())
+                page.result.pageNumber = known->second;
+
+            if (options.mosaicPages > 0) {
+                if (!page.regions.empty())
+                    page.img = img;
+                batch.push_back(move(page));
+                if (batch.size() >= size_t(options.mosaicPages))
+                    flushMosaic(options, scanner, batch, engines, withHeader, document);
+                continue;
+            }
+
+            const auto pageStarted = chrono::steady_clock::now();
+            processPage(options, scanner, keywordTemplates, img, page, engines);
+            if (page.result.skipReason.empty())
+                page.result.cost.ocrMs = chrono::duration<double, milli>(chrono::steady_clock::now() - pageStarted).count();
+            // Без восстановления порядка номер страницы нужен только первой подписи таблицы после найденного перечня.
+            if (known == pageNumbers.end() && !document.contents.listed.empty() && startsTable(page.result))
+                page.result.pageNumber = recognizePageNumber(engines[0].get(), img);
+            restorePageScale(page);
+            emitPage(page.result, withHeader, document);
+        }
+    }
+
+    if (!batch.empty())
+        flushMosaic(options, scanner, batch, engines, withHeader, document);
+
+    if (options.reportTime) {
+        // Init экземпляров Tesseract в потоках страниц не входит в замер.
+        const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now()
+            - max(started, document.enginesReady));
+        cout << "Время обработки: " << elapsed.count() << " мс, страниц: " << options.images.size() << endl;
+    }
+
+    reportReferences(document.references);
+    reportContents(document.contents);
+
+    cout << "Нажмите Enter, чтобы выйти...";
+    cin.get();  // Добавлено ожидание ввода
+
+    return exitCode;
 }
\ No newline at end of file